@@ -0,0 +1,94 @@
+#ifndef POLYCUBES_BOXCONSTRAINT_H_
+#define POLYCUBES_BOXCONSTRAINT_H_
+
+#include "coord.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// Restricts the search to polycubes that fit into an A×B×C box in some
+// orientation. The rotations can put any axis of the shape along any axis of
+// the box, so a shape fits iff its sorted extents are no larger than the
+// sorted box dimensions.
+//
+// Every polycube that fits has a sub-polycube with one cube fewer that also
+// fits, so pruning at every level of the search loses nothing.
+struct BoxConstraint
+{
+    // sorted box dimensions; unconstrained by default
+    std::array<int, 3> dims{
+        std::numeric_limits<int>::max(), std::numeric_limits<int>::max(), std::numeric_limits<int>::max()};
+
+    BoxConstraint() = default;
+
+    BoxConstraint(int a, int b, int c) : dims{a, b, c}
+    {
+        if (a <= 0 || b <= 0 || c <= 0) throw std::invalid_argument("box dimensions must be positive");
+        std::sort(dims.begin(), dims.end());
+    }
+
+    // parse "AxBxC"
+    static BoxConstraint parse(std::string_view spec)
+    {
+        std::array<int, 3> d{};
+        auto const* p = spec.data();
+        auto const* end = spec.data() + spec.size();
+        for (int i = 0; i < 3; ++i) {
+            auto [next, ec] = std::from_chars(p, end, d[i]);
+            if (ec != std::errc{}) throw std::invalid_argument("invalid box specification: " + std::string{spec});
+            p = next;
+            if (i < 2) {
+                if (p == end || (*p != 'x' && *p != 'X')) {
+                    throw std::invalid_argument("invalid box specification: " + std::string{spec});
+                }
+                ++p;
+            }
+        }
+        if (p != end) throw std::invalid_argument("invalid box specification: " + std::string{spec});
+        return BoxConstraint{d[0], d[1], d[2]};
+    }
+
+    bool unconstrained() const { return dims[0] == std::numeric_limits<int>::max(); }
+
+    // does a shape with these extents fit?
+    bool fits(int dx, int dy, int dz) const
+    {
+        std::array<int, 3> extents{dx, dy, dz};
+        std::sort(extents.begin(), extents.end());
+        return extents[0] <= dims[0] && extents[1] <= dims[1] && extents[2] <= dims[2];
+    }
+};
+
+// Minimum and maximum coordinates of a set of cubes, used to check cheaply
+// whether an additional cube still fits a BoxConstraint
+struct BoundingBox
+{
+    Coord lo;
+    Coord hi;
+
+    template<typename CoordRange>
+    explicit BoundingBox(CoordRange const& coords)
+        : lo{min_coords(coords)}, hi{max_coords(coords)}
+    {
+    }
+
+    bool fits(BoxConstraint const& box) const
+    {
+        return box.fits(hi.x() - lo.x() + 1, hi.y() - lo.y() + 1, hi.z() - lo.z() + 1);
+    }
+
+    // would it still fit with an additional cube at c?
+    bool fits_with(BoxConstraint const& box, Coord const& c) const
+    {
+        return box.fits(std::max(hi.x(), c.x()) - std::min(lo.x(), c.x()) + 1,
+                        std::max(hi.y(), c.y()) - std::min(lo.y(), c.y()) + 1,
+                        std::max(hi.z(), c.z()) - std::min(lo.z(), c.z()) + 1);
+    }
+};
+
+#endif // POLYCUBES_BOXCONSTRAINT_H_
@@ -2,6 +2,7 @@
 #define POLYCUBES_COORD_H_
 
 #include <array>
+#include <cstdlib>
 #include <cstdint>
 #include <functional>
 #include <limits>
@@ -115,6 +116,50 @@ Coord min_coords(CoordRange coords)
     return {min_x, min_y, min_z};
 }
 
+template<typename CoordRange>
+Coord max_coords(CoordRange coords)
+{
+    Coord::Scalar max_x = std::numeric_limits<Coord::Scalar>::min();
+    Coord::Scalar max_y = std::numeric_limits<Coord::Scalar>::min();
+    Coord::Scalar max_z = std::numeric_limits<Coord::Scalar>::min();
+
+    for (auto const& p : coords)
+    {
+        auto [x, y, z] = p.xyz;
+        max_x = std::max(x, max_x);
+        max_y = std::max(y, max_y);
+        max_z = std::max(z, max_z);
+    }
+    return {max_x, max_y, max_z};
+}
+
+// Each rotation maps axis i of the result to sign[i] times axis[i] of the
+// original coordinate, i.e. it is a signed permutation of the axes
+struct AxisPermutation
+{
+    std::array<int8_t, 3> axis;
+    std::array<int8_t, 3> sign;
+};
+
+// the 24 rotations of Coord::rot, as signed axis permutations
+inline std::array<AxisPermutation, N_ROTATIONS> const& axis_permutations()
+{
+    static auto const table = [] {
+        std::array<AxisPermutation, N_ROTATIONS> result{};
+        for (int r = 0; r < N_ROTATIONS; ++r) {
+            // every component of (1 2 3) is distinct, so its image under the
+            // rotation tells us where each axis ends up
+            auto p = Coord{1, 2, 3}.rot(r);
+            for (int i = 0; i < 3; ++i) {
+                result[r].axis[i] = std::abs(p.xyz[i]) - 1;
+                result[r].sign[i] = p.xyz[i] < 0 ? -1 : 1;
+            }
+        }
+        return result;
+    }();
+    return table;
+}
+
 inline bool operator==(Coord const& a, Coord const& b)
 {
     return a.x() == b.x() && a.y() == b.y() && a.z() == b.z();
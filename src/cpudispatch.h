@@ -0,0 +1,67 @@
+#ifndef POLYCUBES_CPUDISPATCH_H_
+#define POLYCUBES_CPUDISPATCH_H_
+
+#include <cstdlib>
+#include <string_view>
+
+// The hot kernels are compiled several times for different instruction set
+// extensions, and the best variant the CPU supports is picked at run time.
+// This way a generic build still makes use of AVX2/AVX-512 where available.
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define POLYCUBES_X86_DISPATCH 1
+#define POLYCUBES_ALWAYS_INLINE [[gnu::always_inline]] inline
+#define POLYCUBES_TARGET_AVX2 [[gnu::target("avx2")]]
+#define POLYCUBES_TARGET_AVX512 [[gnu::target("avx512f,avx512bw,avx512vl")]]
+#else
+#define POLYCUBES_X86_DISPATCH 0
+#define POLYCUBES_ALWAYS_INLINE inline
+#endif
+
+enum class IsaLevel
+{
+    generic,
+    avx2,
+    avx512
+};
+
+inline char const* isa_name(IsaLevel isa)
+{
+    switch (isa)
+    {
+        case IsaLevel::generic: return "generic";
+        case IsaLevel::avx2: return "avx2";
+        case IsaLevel::avx512: return "avx512";
+    }
+    return "unknown";
+}
+
+inline IsaLevel detect_isa()
+{
+    auto level = IsaLevel::generic;
+#if POLYCUBES_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) level = IsaLevel::avx2;
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+        && __builtin_cpu_supports("avx512vl")) level = IsaLevel::avx512;
+#endif
+
+    // The environment variable POLYCUBES_ISA can select a lesser variant
+    // (e.g. for benchmarking), but never one the CPU doesn't support
+    if (auto const* env = std::getenv("POLYCUBES_ISA"); env != nullptr) {
+        std::string_view requested{env};
+        for (auto candidate : {IsaLevel::generic, IsaLevel::avx2, IsaLevel::avx512}) {
+            if (requested == isa_name(candidate) && candidate < level) level = candidate;
+        }
+    }
+    return level;
+}
+
+// the kernel variant in use, determined once
+inline IsaLevel cpu_isa()
+{
+    static IsaLevel const level = detect_isa();
+    return level;
+}
+
+#endif // POLYCUBES_CPUDISPATCH_H_
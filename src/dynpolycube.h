@@ -0,0 +1,224 @@
+#ifndef POLYCUBES_DYNPOLYCUBE_H_
+#define POLYCUBES_DYNPOLYCUBE_H_
+
+#include "coord.h"
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+// Runtime-sized polycubes: the cube count is not part of the type, so one
+// instantiation of the search handles all sizes. This is slower than
+// PolyCube<SIZE>, but it is not limited to the sizes compiled in.
+
+// marks the runtime-sized variant in places that take a cube count as a
+// template parameter
+size_t constexpr DYNAMIC_CUBE_COUNT = std::dynamic_extent;
+
+// The largest possible shape (a straight line) has to fit into Coord::Scalar,
+// including the neighbouring cell at -1
+size_t constexpr MAX_CUBE_COUNT = std::numeric_limits<Coord::Scalar>::max();
+
+// A view of a runtime-sized polycube; the coordinates are owned elsewhere
+// (typically by a PolyCubeArena)
+struct DynPolyCube
+{
+    std::span<const Coord> cubes;
+
+    size_t cube_count() const { return cubes.size(); }
+};
+
+inline std::ostream& operator<<(std::ostream& os, DynPolyCube const& s)
+{
+    os << "[[ ";
+    for (auto const& p : s.cubes) {
+        os << p << ' ';
+    }
+    os << "]]";
+    return os;
+}
+
+inline bool operator==(DynPolyCube const& a, DynPolyCube const& b)
+{
+    return std::equal(a.cubes.begin(), a.cubes.end(), b.cubes.begin(), b.cubes.end());
+}
+
+inline bool operator<(DynPolyCube const& a, DynPolyCube const& b)
+{
+    return std::lexicographical_compare(a.cubes.begin(), a.cubes.end(), b.cubes.begin(), b.cubes.end());
+}
+
+// write the normal form of shape to out (the same as PolyCube<SIZE>::normal())
+inline void normalize(std::span<const Coord> shape, std::span<Coord> out)
+{
+    auto const n = shape.size();
+    if (n > MAX_CUBE_COUNT) throw std::invalid_argument("normalize: too many cubes");
+
+    std::array<Coord, MAX_CUBE_COUNT> buf;
+    auto rotated = std::span{buf}.first(n);
+
+    for (int r = 0; r < N_ROTATIONS; ++r) {
+        std::transform(shape.begin(), shape.end(), rotated.begin(),
+            [r](Coord const& p) { return p.rot(r); });
+        auto origin = min_coords(rotated);
+        for (auto& block : rotated) {
+            block -= origin;
+        }
+        std::sort(rotated.begin(), rotated.end());
+
+        if (r == 0 || std::lexicographical_compare(rotated.begin(), rotated.end(), out.begin(), out.end())) {
+            std::copy(rotated.begin(), rotated.end(), out.begin());
+        }
+    }
+}
+
+// true if every cube can be reached from the first through shared faces;
+// the cubes must be sorted (as in a normalized shape)
+inline bool is_connected(std::span<const Coord> shape)
+{
+    static std::array<Coord, 6> const directions{
+        Coord{1, 0, 0}, Coord{-1, 0, 0}, Coord{0, 1, 0},
+        Coord{0, -1, 0}, Coord{0, 0, 1}, Coord{0, 0, -1}};
+
+    if (shape.empty()) return true;
+    std::array<bool, MAX_CUBE_COUNT> seen{};
+    std::array<size_t, MAX_CUBE_COUNT> stack;
+    size_t stack_size{}, reached{1};
+    seen[0] = true;
+    stack[stack_size++] = 0;
+    while (stack_size != 0) {
+        auto const& cube = shape[stack[--stack_size]];
+        for (auto const& d : directions) {
+            auto it = std::lower_bound(shape.begin(), shape.end(), cube + d);
+            if (it == shape.end() || *it != cube + d) continue;
+            auto j = (size_t)(it - shape.begin());
+            if (seen[j]) continue;
+            seen[j] = true;
+            ++reached;
+            stack[stack_size++] = j;
+        }
+    }
+    return reached == shape.size();
+}
+
+// A list of polycubes of the same (runtime) size, stored back to back in one
+// flat array of coordinates - the same layout as in the file
+class PolyCubeArena
+{
+public:
+    using value_type = DynPolyCube;
+
+    explicit PolyCubeArena(size_t cube_count = 0) : m_cube_count{cube_count} {}
+
+    size_t cube_count() const { return m_cube_count; }
+    size_t size() const { return m_cube_count == 0 ? 0 : m_coords.size() / m_cube_count; }
+    bool empty() const { return m_coords.empty(); }
+
+    DynPolyCube operator[](size_t i) const
+    {
+        return {std::span{m_coords}.subspan(i * m_cube_count, m_cube_count)};
+    }
+
+    // append a shape and return its coordinates to be filled in
+    std::span<Coord> push_back()
+    {
+        m_coords.resize(m_coords.size() + m_cube_count);
+        return std::span{m_coords}.last(m_cube_count);
+    }
+
+    void push_back(std::span<const Coord> shape)
+    {
+        m_coords.insert(m_coords.end(), shape.begin(), shape.end());
+    }
+
+    void resize(size_t count) { m_coords.resize(count * m_cube_count); }
+    void clear() { m_coords.clear(); }
+
+    Coord* data() { return m_coords.data(); }
+    Coord const* data() const { return m_coords.data(); }
+
+    // sort the shapes and remove duplicates
+    void sort_unique()
+    {
+        std::vector<size_t> order(size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(),
+            [this](size_t a, size_t b) { return (*this)[a] < (*this)[b]; });
+
+        std::vector<Coord> sorted;
+        sorted.reserve(m_coords.size());
+        for (size_t i{}; i < order.size(); ++i) {
+            if (i != 0 && (*this)[order[i]] == (*this)[order[i - 1]]) continue;
+            auto shape = (*this)[order[i]];
+            sorted.insert(sorted.end(), shape.cubes.begin(), shape.cubes.end());
+        }
+        m_coords = std::move(sorted);
+    }
+
+    class Iter
+    {
+    public:
+        using value_type = DynPolyCube;
+        using reference = value_type const&;
+        using pointer = value_type const*;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        Iter() = default;
+
+        Iter(PolyCubeArena const* parent, size_t pos)
+            : m_parent{parent}, m_pos{pos}
+        {
+            update();
+        }
+
+        reference operator*() const { return m_current; }
+        pointer operator->() const { return &m_current; }
+
+        Iter& operator++()
+        {
+            ++m_pos;
+            update();
+            return *this;
+        }
+
+        Iter operator++(int)
+        {
+            auto copy = *this;
+            ++(*this);
+            return copy;
+        }
+
+        bool operator==(Iter const& other) const
+        {
+            return m_parent == other.m_parent && m_pos == other.m_pos;
+        }
+
+        bool operator!=(Iter const& other) const { return !(*this == other); }
+
+    private:
+        void update()
+        {
+            if (m_pos < m_parent->size()) m_current = (*m_parent)[m_pos];
+        }
+
+        PolyCubeArena const* m_parent{};
+        size_t m_pos{};
+        DynPolyCube m_current{};
+    };
+
+    Iter begin() const { return Iter{this, 0}; }
+    Iter end() const { return Iter{this, size()}; }
+
+private:
+    size_t m_cube_count;
+    std::vector<Coord> m_coords;
+};
+
+#endif // POLYCUBES_DYNPOLYCUBE_H_
@@ -0,0 +1,81 @@
+#ifndef POLYCUBES_MAPPEDFILE_H_
+#define POLYCUBES_MAPPEDFILE_H_
+
+#include <cstddef>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define POLYCUBES_HAVE_MMAP 1
+#else
+#define POLYCUBES_HAVE_MMAP 0
+#endif
+
+// A read-only view of a whole file, memory-mapped where possible, so that
+// several threads can read different parts of it without seeking. Without
+// mmap, the file is read into memory.
+class MappedFile
+{
+public:
+    explicit MappedFile(std::filesystem::path const& path)
+    {
+#if POLYCUBES_HAVE_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error(std::format("Could not open {}", path.string()));
+        struct stat st{};
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error(std::format("Could not stat {}", path.string()));
+        }
+        m_size = (size_t)st.st_size;
+        if (m_size != 0) {
+            void* p = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error(std::format("Could not map {}", path.string()));
+            }
+            m_data = static_cast<std::byte const*>(p);
+            // read front to back; lets the kernel read ahead further
+            ::madvise(p, m_size, MADV_SEQUENTIAL);
+        }
+        ::close(fd);
+#else
+        std::ifstream in{path, std::ios::binary | std::ios::in};
+        if (!in) throw std::runtime_error(std::format("Could not open {}", path.string()));
+        m_buffer.resize(std::filesystem::file_size(path));
+        in.read(reinterpret_cast<char*>(m_buffer.data()), (std::streamsize)m_buffer.size());
+        m_data = m_buffer.data();
+        m_size = m_buffer.size();
+#endif
+    }
+
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    ~MappedFile()
+    {
+#if POLYCUBES_HAVE_MMAP
+        if (m_data != nullptr) ::munmap(const_cast<std::byte*>(m_data), m_size);
+#endif
+    }
+
+    std::span<std::byte const> bytes() const { return {m_data, m_size}; }
+    size_t size() const { return m_size; }
+
+private:
+    std::byte const* m_data{};
+    size_t m_size{};
+#if !POLYCUBES_HAVE_MMAP
+    std::vector<std::byte> m_buffer;
+#endif
+};
+
+#endif // POLYCUBES_MAPPEDFILE_H_
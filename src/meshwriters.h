@@ -0,0 +1,501 @@
+#ifndef POLYCUBES_MESHWRITERS_H_
+#define POLYCUBES_MESHWRITERS_H_
+
+#include "dynpolycube.h"
+#include "polycubemesh.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Writers for the mesh file formats of polycubes2obj. They convert the list
+// in blocks of shapes (see MeshBlock), keep only a fixed-size output buffer,
+// and complete the file when they are destroyed. The binary formats are
+// written little-endian, like the polycube lists.
+
+// Output file with a large write buffer. Write errors are only checked by
+// close(), which throws std::runtime_error if anything went wrong.
+class MeshFile
+{
+public:
+    static size_t constexpr BUFFER_SIZE = 1 << 20;
+
+    explicit MeshFile(std::filesystem::path const& path)
+        : m_path{path}, m_stream{path, std::ios::out | std::ios::trunc | std::ios::binary}
+    {
+        if (!m_stream) throw std::runtime_error(std::format("Could not open {}", path.string()));
+        m_buffer.reserve(BUFFER_SIZE + 4096);
+    }
+
+    MeshFile(MeshFile const&) = delete;
+    MeshFile& operator=(MeshFile const&) = delete;
+
+    ~MeshFile()
+    {
+        if (m_stream.is_open()) flush();
+    }
+
+    std::string& buffer() { return m_buffer; }
+
+    template <typename T>
+    void put(T const& value)
+    {
+        m_buffer.append(reinterpret_cast<char const*>(&value), sizeof(T));
+    }
+
+    // write a block of data (large blocks bypass the buffer)
+    void write(std::string_view data)
+    {
+        if (m_buffer.size() + data.size() < BUFFER_SIZE) {
+            m_buffer += data;
+        } else {
+            flush();
+            m_stream.write(data.data(), (std::streamsize)data.size());
+        }
+    }
+
+    void flush()
+    {
+        m_stream.write(m_buffer.data(), (std::streamsize)m_buffer.size());
+        m_buffer.clear();
+    }
+
+    void close()
+    {
+        flush();
+        m_stream.close();
+        if (!m_stream) throw std::runtime_error(std::format("Error writing {}", m_path.string()));
+    }
+
+    // append the contents of another file
+    void append_file(std::filesystem::path const& path)
+    {
+        flush();
+        std::ifstream in{path, std::ios::in | std::ios::binary};
+        m_buffer.resize(BUFFER_SIZE);
+        while (in) {
+            in.read(m_buffer.data(), (std::streamsize)m_buffer.size());
+            m_stream.write(m_buffer.data(), in.gcount());
+        }
+        m_buffer.clear();
+        if (in.bad()) throw std::runtime_error(std::format("Error reading {}", path.string()));
+    }
+
+    // overwrite already written bytes (e.g. counts in a header)
+    void patch(std::streamoff pos, std::string_view data)
+    {
+        flush();
+        auto end = m_stream.tellp();
+        m_stream.seekp(pos);
+        m_stream.write(data.data(), (std::streamsize)data.size());
+        m_stream.seekp(end);
+    }
+
+private:
+    std::filesystem::path m_path;
+    std::ofstream m_stream;
+    std::string m_buffer;
+};
+
+// A run of consecutive shapes that is converted independently of the other
+// blocks, in two steps that can run in parallel: build() the geometry, then
+// (once the vertex count of the blocks before it is known) encode() it. The
+// writer's append() then writes the blocks in order, and finish() completes
+// the file.
+struct MeshBlock
+{
+    PolyCubeArena shapes;
+    // grid position of the first shape
+    size_t first_position{};
+
+    // indexed mesh, with block-local vertex indices
+    std::vector<vec3> vertices;
+    std::vector<std::array<uint32_t, 4>> quads;
+    std::vector<uint8_t> faces;
+
+    // number of vertices in the blocks before this one
+    size_t vertex_base{};
+
+    // encoded output (some formats have a second section)
+    std::string data;
+    std::string data2;
+    size_t element_count{};
+
+    void clear()
+    {
+        shapes.clear();
+        vertices.clear();
+        quads.clear();
+        faces.clear();
+        data.clear();
+        data2.clear();
+        element_count = 0;
+    }
+
+    template <typename T>
+    static void put(std::string& out, T const& value)
+    {
+        out.append(reinterpret_cast<char const*>(&value), sizeof(T));
+    }
+};
+
+// the indexed meshes of all shapes of the block
+inline void build_indexed_mesh(MeshBlock& b, GridLayout const& layout)
+{
+    ShapeMesh mesh;
+    for (size_t i{}; i < b.shapes.size(); ++i) {
+        mesh.build(b.shapes[i].cubes, layout.offset(b.first_position + i));
+        auto const base = (uint32_t)b.vertices.size();
+        b.vertices.insert(b.vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+        for (size_t q{}; q < mesh.quads.size(); ++q) {
+            auto quad = mesh.quads[q];
+            for (auto& idx : quad) idx += base;
+            b.quads.push_back(quad);
+            b.faces.push_back((uint8_t)mesh.faces[q]);
+        }
+    }
+}
+
+// Wavefront OBJ (text): the vertices of each shape, then its faces, which
+// refer to the vertices by their global (1-based) index. The six face normals
+// are shared by all faces.
+class ObjWriter
+{
+public:
+    ObjWriter(std::filesystem::path const& path, size_t /*shape_count*/, size_t /*cube_count*/)
+        : m_file{path}
+    {
+        auto& buf = m_file.buffer();
+        buf += "# List of vertex normals\n";
+        for (auto const& face : CUBE_FACES) {
+            std::format_to(std::back_inserter(buf), "vn {} {} {}\n", face.normal[0], face.normal[1], face.normal[2]);
+        }
+    }
+
+    static void build(MeshBlock& b, GridLayout const& layout) { build_indexed_mesh(b, layout); }
+
+    static void encode(MeshBlock& b)
+    {
+        auto out = std::back_inserter(b.data);
+        for (auto const& v : b.vertices) {
+            std::format_to(out, "v {} {} {}\n", v[0], v[1], v[2]);
+        }
+        auto const v0 = b.vertex_base + 1;
+        for (size_t i{}; i < b.quads.size(); ++i) {
+            auto const& q = b.quads[i];
+            auto const vn = b.faces[i] + 1;
+            std::format_to(out, "f {}//{} {}//{} {}//{} {}//{}\n",
+                v0 + q[0], vn, v0 + q[1], vn, v0 + q[2], vn, v0 + q[3], vn);
+        }
+    }
+
+    void append(MeshBlock const& b)
+    {
+        m_file.write(b.data);
+        m_vertex_count += b.vertices.size();
+    }
+
+    void finish() { m_file.close(); }
+
+    size_t vertex_count() const { return m_vertex_count; }
+
+private:
+    MeshFile m_file;
+    size_t m_vertex_count{};
+};
+
+// Binary PLY with quad faces. PLY has all vertices before all faces, so the
+// faces go to a temporary file that is appended at the end. The vertex and
+// face counts in the header are only known then, too, so they are written as
+// space-padded placeholders and filled in.
+class PlyWriter
+{
+public:
+    PlyWriter(std::filesystem::path const& path, size_t /*shape_count*/, size_t /*cube_count*/)
+        : m_file{path},
+          m_faces_path{path.parent_path() / std::format(".{}.faces.tmp", path.filename().string())},
+          m_faces{m_faces_path}
+    {
+        auto& buf = m_file.buffer();
+        buf += "ply\nformat binary_little_endian 1.0\ncomment polycubes\n";
+        buf += "element vertex ";
+        m_vertex_count_pos = (std::streamoff)buf.size();
+        buf += count_field(0);
+        buf += "property float x\nproperty float y\nproperty float z\n";
+        buf += "element face ";
+        m_face_count_pos = (std::streamoff)buf.size();
+        buf += count_field(0);
+        buf += "property list uchar uint vertex_indices\nend_header\n";
+    }
+
+    ~PlyWriter()
+    {
+        std::error_code ec;
+        std::filesystem::remove(m_faces_path, ec);
+    }
+
+    PlyWriter(PlyWriter const&) = delete;
+    PlyWriter& operator=(PlyWriter const&) = delete;
+
+    static void build(MeshBlock& b, GridLayout const& layout) { build_indexed_mesh(b, layout); }
+
+    static void encode(MeshBlock& b)
+    {
+        if (b.vertex_base + b.vertices.size() > std::numeric_limits<uint32_t>::max()) {
+            throw std::runtime_error("too many vertices for PLY");
+        }
+        b.data.append(reinterpret_cast<char const*>(b.vertices.data()), b.vertices.size() * sizeof(vec3));
+        for (auto const& q : b.quads) {
+            MeshBlock::put(b.data2, uint8_t{4});
+            for (auto i : q) MeshBlock::put(b.data2, uint32_t(b.vertex_base + i));
+        }
+    }
+
+    void append(MeshBlock const& b)
+    {
+        m_file.write(b.data);
+        m_faces.write(b.data2);
+        m_vertex_count += b.vertices.size();
+        m_face_count += b.quads.size();
+    }
+
+    void finish()
+    {
+        m_faces.close();
+        m_file.append_file(m_faces_path);
+        m_file.patch(m_vertex_count_pos, count_field(m_vertex_count));
+        m_file.patch(m_face_count_pos, count_field(m_face_count));
+        m_file.close();
+    }
+
+    size_t vertex_count() const { return m_vertex_count; }
+
+private:
+    static std::string count_field(size_t n) { return std::format("{:<20}\n", n); }
+
+    MeshFile m_file;
+    std::filesystem::path m_faces_path;
+    MeshFile m_faces;
+    size_t m_vertex_count{};
+    size_t m_face_count{};
+    std::streamoff m_vertex_count_pos{};
+    std::streamoff m_face_count_pos{};
+};
+
+// Binary STL: unindexed triangles with face normals, two per quad. The
+// triangle count after the 80-byte header is filled in at the end.
+class StlWriter
+{
+public:
+    StlWriter(std::filesystem::path const& path, size_t /*shape_count*/, size_t /*cube_count*/)
+        : m_file{path}
+    {
+        std::array<char, 80> header{};
+        std::memcpy(header.data(), "polycubes", 9);
+        m_file.buffer().append(header.data(), header.size());
+        m_file.put(uint32_t{0});
+    }
+
+    StlWriter(StlWriter const&) = delete;
+    StlWriter& operator=(StlWriter const&) = delete;
+
+    static void build(MeshBlock& b, GridLayout const& layout)
+    {
+        for (size_t i{}; i < b.shapes.size(); ++i) {
+            for_each_visible_face(b.shapes[i].cubes, layout.offset(b.first_position + i), [&](Quad const& q) {
+                auto const& normal = CUBE_FACES[q.face].normal;
+                for (auto const& tri : {std::array{0, 1, 2}, std::array{0, 2, 3}}) {
+                    MeshBlock::put(b.data, normal);
+                    for (int k : tri) MeshBlock::put(b.data, q.vertices[k]);
+                    MeshBlock::put(b.data, uint16_t{0});
+                }
+                b.element_count += 2;
+            });
+        }
+    }
+
+    static void encode(MeshBlock&) {}
+
+    void append(MeshBlock const& b)
+    {
+        m_triangle_count += b.element_count;
+        if (m_triangle_count > std::numeric_limits<uint32_t>::max()) {
+            throw std::runtime_error("too many triangles for STL");
+        }
+        m_file.write(b.data);
+    }
+
+    void finish()
+    {
+        auto count = (uint32_t)m_triangle_count;
+        m_file.patch(80, std::string_view{reinterpret_cast<char const*>(&count), sizeof(count)});
+        m_file.close();
+    }
+
+    size_t vertex_count() const { return 0; }
+
+private:
+    MeshFile m_file;
+    size_t m_triangle_count{};
+};
+
+// Binary glTF (GLB) with a single unit cube mesh, instanced once per cube
+// through EXT_mesh_gpu_instancing, so every cube costs only its translation
+// (12 bytes). The number of cubes is known in advance, so the whole layout
+// (JSON and buffer) is too, and the translations are streamed.
+class GlbWriter
+{
+public:
+    GlbWriter(std::filesystem::path const& path, size_t shape_count, size_t cube_count)
+        : m_file{path}, m_instance_count{shape_count * cube_count}
+    {
+        // the cube: 4 vertices per face (for the normals), two triangles each
+        std::array<vec3, 24> positions;
+        std::array<vec3, 24> normals;
+        std::array<uint16_t, 36> indices;
+        for (size_t f{}; f < CUBE_FACES.size(); ++f) {
+            for (size_t k{}; k < 4; ++k) {
+                positions[4 * f + k] = CUBE_FACES[f].corners[k];
+                normals[4 * f + k] = CUBE_FACES[f].normal;
+            }
+            auto const v0 = uint16_t(4 * f);
+            std::array<uint16_t, 6> tris{v0, uint16_t(v0 + 1), uint16_t(v0 + 2), v0, uint16_t(v0 + 2), uint16_t(v0 + 3)};
+            std::copy(tris.begin(), tris.end(), indices.begin() + 6 * f);
+        }
+
+        size_t constexpr positions_offset = 0;
+        size_t constexpr normals_offset = positions_offset + sizeof(positions);
+        size_t constexpr indices_offset = normals_offset + sizeof(normals);
+        size_t constexpr translations_offset = indices_offset + sizeof(indices);
+        static_assert(translations_offset % 4 == 0);
+        size_t const bin_length = translations_offset + m_instance_count * sizeof(vec3);
+
+        auto json = std::format(
+            R"({{"asset":{{"version":"2.0","generator":"polycubes2obj"}},)"
+            R"("extensionsUsed":["EXT_mesh_gpu_instancing"],"extensionsRequired":["EXT_mesh_gpu_instancing"],)"
+            R"("scene":0,"scenes":[{{"nodes":[0]}}],)"
+            R"("nodes":[{{"mesh":0,"extensions":{{"EXT_mesh_gpu_instancing":{{"attributes":{{"TRANSLATION":3}}}}}}}}],)"
+            R"("meshes":[{{"primitives":[{{"attributes":{{"POSITION":0,"NORMAL":1}},"indices":2}}]}}],)"
+            R"("buffers":[{{"byteLength":{}}}],)"
+            R"("bufferViews":[)"
+            R"({{"buffer":0,"byteOffset":{},"byteLength":{},"target":34962}},)"
+            R"({{"buffer":0,"byteOffset":{},"byteLength":{},"target":34962}},)"
+            R"({{"buffer":0,"byteOffset":{},"byteLength":{},"target":34963}},)"
+            R"({{"buffer":0,"byteOffset":{},"byteLength":{}}}],)"
+            R"("accessors":[)"
+            R"({{"bufferView":0,"componentType":5126,"count":24,"type":"VEC3","min":[-0.5,-0.5,-0.5],"max":[0.5,0.5,0.5]}},)"
+            R"({{"bufferView":1,"componentType":5126,"count":24,"type":"VEC3"}},)"
+            R"({{"bufferView":2,"componentType":5123,"count":36,"type":"SCALAR"}},)"
+            R"({{"bufferView":3,"componentType":5126,"count":{},"type":"VEC3"}}]}})",
+            bin_length,
+            positions_offset, sizeof(positions), normals_offset, sizeof(normals),
+            indices_offset, sizeof(indices), translations_offset, m_instance_count * sizeof(vec3),
+            m_instance_count);
+        // chunks are padded to 4 bytes, JSON with spaces
+        json.resize((json.size() + 3) / 4 * 4, ' ');
+
+        size_t const total_length = 12 + 8 + json.size() + 8 + bin_length;
+        if (total_length > std::numeric_limits<uint32_t>::max()) throw std::runtime_error("too many cubes for GLB");
+
+        m_file.put(uint32_t{0x46546C67}); // "glTF"
+        m_file.put(uint32_t{2});
+        m_file.put(uint32_t(total_length));
+        m_file.put(uint32_t(json.size()));
+        m_file.put(uint32_t{0x4E4F534A}); // "JSON"
+        m_file.buffer() += json;
+        m_file.put(uint32_t(bin_length));
+        m_file.put(uint32_t{0x004E4942}); // "BIN\0"
+        m_file.put(positions);
+        m_file.put(normals);
+        m_file.put(indices);
+    }
+
+    GlbWriter(GlbWriter const&) = delete;
+    GlbWriter& operator=(GlbWriter const&) = delete;
+
+    static void build(MeshBlock& b, GridLayout const& layout)
+    {
+        for (size_t i{}; i < b.shapes.size(); ++i) {
+            auto const offset = layout.offset(b.first_position + i);
+            for (auto const& c : b.shapes[i].cubes) {
+                MeshBlock::put(b.data, vec3{offset[0] + c.x(), offset[1] + c.y(), offset[2] + c.z()});
+            }
+            b.element_count += b.shapes.cube_count();
+        }
+    }
+
+    static void encode(MeshBlock&) {}
+
+    void append(MeshBlock const& b)
+    {
+        if (m_written + b.element_count > m_instance_count) throw std::runtime_error("more cubes than announced");
+        m_file.write(b.data);
+        m_written += b.element_count;
+    }
+
+    void finish()
+    {
+        // should not happen with a consistent input file, but the layout is fixed
+        for (; m_written < m_instance_count; ++m_written) m_file.put(vec3{});
+        m_file.close();
+    }
+
+    size_t vertex_count() const { return 0; }
+
+private:
+    MeshFile m_file;
+    size_t m_instance_count;
+    size_t m_written{};
+};
+
+enum class MeshFormat
+{
+    obj,
+    ply,
+    stl,
+    glb
+};
+
+// from a name or file extension (with or without the dot)
+inline MeshFormat parse_mesh_format(std::string_view name)
+{
+    if (name.starts_with('.')) name.remove_prefix(1);
+    if (name == "obj") return MeshFormat::obj;
+    if (name == "ply") return MeshFormat::ply;
+    if (name == "stl") return MeshFormat::stl;
+    if (name == "glb") return MeshFormat::glb;
+    throw std::invalid_argument(std::format("unknown mesh format: {}", name));
+}
+
+inline char const* mesh_format_extension(MeshFormat format)
+{
+    switch (format) {
+    case MeshFormat::obj: return ".obj";
+    case MeshFormat::ply: return ".ply";
+    case MeshFormat::stl: return ".stl";
+    case MeshFormat::glb: return ".glb";
+    }
+    return "";
+}
+
+// the format for an output file name: the one its extension names, else OBJ
+inline MeshFormat mesh_format_of_file(std::filesystem::path const& path)
+{
+    auto const ext = path.extension().string();
+    for (auto format : {MeshFormat::ply, MeshFormat::stl, MeshFormat::glb}) {
+        if (ext == mesh_format_extension(format)) return format;
+    }
+    return MeshFormat::obj;
+}
+
+#endif // POLYCUBES_MESHWRITERS_H_
@@ -0,0 +1,201 @@
+#ifndef POLYCUBES_METRICS_H_
+#define POLYCUBES_METRICS_H_
+
+#include "util.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Counters and timers for the hot paths. They are always compiled in, so
+// they have to be cheap: every thread has its own set of counters, which only
+// it writes to (no locked instructions), and which are summed up on demand.
+
+enum class Metric : size_t
+{
+    seeds,                  // seeds expanded by find_larger
+    candidates,             // shapes generated (before deduplication)
+    occupied_rejections,    // candidate cells that were already occupied
+    duplicates,             // candidates that were already in the result set
+    normalize_ns,           // time spent normalizing candidates
+    insert_ns,              // time spent inserting into result sets
+    set_merge_ns,           // time spent merging in-memory result sets
+    disk_merge_ns,          // time spent merging results with the on-disk cache
+    queue_wait_ns,          // time the search waited to hand over results
+    emergency_stops,        // ... of which had to wait for the merge worker
+    read_bytes,             // bytes read from polycube list files
+    read_ns,                // time spent reading them
+    write_bytes,            // bytes written to polycube list files
+    write_ns,               // time spent writing them
+    count_
+};
+
+size_t constexpr METRIC_COUNT = static_cast<size_t>(Metric::count_);
+
+inline char const* metric_name(Metric m)
+{
+    static char const* const names[METRIC_COUNT] = {
+        "seeds", "candidates", "occupied_rejections", "duplicates",
+        "normalize_ns", "insert_ns", "set_merge_ns", "disk_merge_ns",
+        "queue_wait_ns", "emergency_stops",
+        "read_bytes", "read_ns", "write_bytes", "write_ns",
+    };
+    return names[static_cast<size_t>(m)];
+}
+
+using MetricValues = std::array<uint64_t, METRIC_COUNT>;
+
+class ThreadMetrics
+{
+public:
+    // only ever called by the owning thread
+    void add(Metric m, uint64_t n = 1)
+    {
+        auto& c = m_values[static_cast<size_t>(m)];
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    uint64_t get(Metric m) const { return m_values[static_cast<size_t>(m)].load(std::memory_order_relaxed); }
+
+private:
+    std::array<std::atomic<uint64_t>, METRIC_COUNT> m_values{};
+};
+
+class MetricsRegistry
+{
+public:
+    static MetricsRegistry& instance()
+    {
+        static MetricsRegistry registry;
+        return registry;
+    }
+
+    // The counters of the calling thread. They are kept after the thread
+    // exits, so that the totals don't go backwards.
+    ThreadMetrics& local()
+    {
+        thread_local ThreadMetrics* metrics = [this] {
+            std::unique_lock lock{m_mutex};
+            return m_threads.emplace_back(std::make_unique<ThreadMetrics>()).get();
+        }();
+        return *metrics;
+    }
+
+    MetricValues totals() const
+    {
+        MetricValues result{};
+        std::unique_lock lock{m_mutex};
+        for (auto const& t : m_threads) {
+            for (size_t i{}; i < METRIC_COUNT; ++i) result[i] += t->get(static_cast<Metric>(i));
+        }
+        return result;
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<ThreadMetrics>> m_threads;
+};
+
+inline ThreadMetrics& thread_metrics() { return MetricsRegistry::instance().local(); }
+
+// Adds the time between construction and destruction to a metric (in ns)
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(Metric m) : m_metric{m}, m_t0{std::chrono::steady_clock::now()} {}
+    ScopedTimer(ScopedTimer const&) = delete;
+    ScopedTimer& operator=(ScopedTimer const&) = delete;
+
+    ~ScopedTimer()
+    {
+        auto dt = std::chrono::steady_clock::now() - m_t0;
+        thread_metrics().add(m_metric, std::chrono::duration_cast<std::chrono::nanoseconds>(dt).count());
+    }
+
+private:
+    Metric m_metric;
+    std::chrono::steady_clock::time_point m_t0;
+};
+
+inline volatile std::sig_atomic_t metrics_dump_requested = 0;
+
+// Writes the totals as JSON lines: periodically to a file (if given), and
+// whenever the process receives SIGUSR1 (to the file, or to stderr)
+class MetricsReporter
+{
+public:
+    MetricsReporter(std::filesystem::path const& path, double interval_seconds)
+        : m_interval{interval_seconds}, m_t0{std::chrono::steady_clock::now()}
+    {
+        if (!path.empty()) {
+            m_file = std::make_unique<std::ofstream>(path, std::ios::out | std::ios::trunc);
+        }
+#ifdef SIGUSR1
+        std::signal(SIGUSR1, [](int) { metrics_dump_requested = 1; });
+#endif
+        m_thread = std::jthread{[this](std::stop_token stop) { run(stop); }};
+    }
+
+    ~MetricsReporter()
+    {
+        m_thread.request_stop();
+        m_thread.join();
+        if (m_file) write("final");
+    }
+
+    // the polycube size currently being generated, for the log
+    void set_level(size_t level) { m_level = level; }
+
+private:
+    void run(std::stop_token stop)
+    {
+        auto last = std::chrono::steady_clock::now();
+        while (!stop.stop_requested()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            if (metrics_dump_requested) {
+                metrics_dump_requested = 0;
+                write("signal");
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (m_file && seconds_between(last, now) >= m_interval) {
+                write("periodic");
+                last = now;
+            }
+        }
+    }
+
+    void write(char const* event)
+    {
+        auto totals = MetricsRegistry::instance().totals();
+        auto line = std::format("{{\"time\": \"{}\", \"elapsed_s\": {:.3f}, \"event\": \"{}\", \"level\": {}",
+            strftime_local("%FT%T", std::chrono::system_clock::now()),
+            seconds_between(m_t0, std::chrono::steady_clock::now()), event, m_level.load());
+        for (size_t i{}; i < METRIC_COUNT; ++i) {
+            line += std::format(", \"{}\": {}", metric_name(static_cast<Metric>(i)), totals[i]);
+        }
+        line += "}\n";
+
+        std::ostream& os = m_file ? *m_file : std::cerr;
+        os << line << std::flush;
+    }
+
+    double m_interval;
+    std::chrono::steady_clock::time_point m_t0;
+    std::unique_ptr<std::ofstream> m_file;
+    std::atomic<size_t> m_level{};
+    std::jthread m_thread;
+};
+
+#endif // POLYCUBES_METRICS_H_
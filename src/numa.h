@@ -0,0 +1,146 @@
+#ifndef POLYCUBES_NUMA_H_
+#define POLYCUBES_NUMA_H_
+
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#define POLYCUBES_HAVE_AFFINITY 1
+#else
+#define POLYCUBES_HAVE_AFFINITY 0
+#endif
+
+// NUMA awareness without libnuma. The nodes and their CPUs are read from
+// sysfs; workers pin themselves to a node while they run, so that the memory
+// they touch first (their seeds and their results) is allocated on that node,
+// and their results are merged per node before the final merge across nodes.
+// With a single node, or where thread affinity isn't available, none of this
+// does anything.
+//
+// The environment variable POLYCUBES_NUMA=off disables it, and
+// POLYCUBES_NUMA_NODES=N splits the CPUs into N nodes (to try the NUMA code
+// paths on a single-node machine).
+class NumaTopology
+{
+public:
+    static NumaTopology& instance()
+    {
+        static NumaTopology topology;
+        return topology;
+    }
+
+    bool active() const { return m_enabled && m_nodes.size() > 1; }
+    void set_enabled(bool enabled) { m_enabled = enabled; }
+
+    size_t node_count() const { return m_nodes.size(); }
+    std::vector<int> const& cpus(size_t node) const { return m_nodes[node]; }
+
+    // the node for worker w of n: contiguous blocks, so that neighbouring
+    // chunks (which share the most shapes) end up on the same node
+    size_t node_for(size_t worker, size_t workers) const
+    {
+        return workers == 0 ? 0 : worker * m_nodes.size() / workers;
+    }
+
+private:
+    NumaTopology()
+    {
+#if POLYCUBES_HAVE_AFFINITY
+        std::filesystem::path const sysfs{"/sys/devices/system/node"};
+        for (size_t node{};; ++node) {
+            std::ifstream in{sysfs / std::format("node{}", node) / "cpulist"};
+            if (!in) break;
+            std::string list;
+            std::getline(in, list);
+            auto cpus = parse_cpu_list(list);
+            if (!cpus.empty()) m_nodes.push_back(std::move(cpus));
+        }
+
+        if (auto const* env = std::getenv("POLYCUBES_NUMA_NODES"); env != nullptr) {
+            split_nodes(std::strtoul(env, nullptr, 10));
+        }
+        if (auto const* env = std::getenv("POLYCUBES_NUMA"); env != nullptr && std::string_view{env} == "off") {
+            m_enabled = false;
+        }
+#endif
+    }
+
+    // "0-3,8-11" -> 0 1 2 3 8 9 10 11
+    static std::vector<int> parse_cpu_list(std::string_view list)
+    {
+        std::vector<int> cpus;
+        while (!list.empty()) {
+            auto comma = list.find(',');
+            auto part = list.substr(0, comma);
+            list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+
+            auto dash = part.find('-');
+            int first = std::atoi(std::string{part.substr(0, dash)}.c_str());
+            int last = dash == std::string_view::npos ? first : std::atoi(std::string{part.substr(dash + 1)}.c_str());
+            for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+        }
+        return cpus;
+    }
+
+    // pretend to have n nodes, dealing out the CPUs round robin (nodes that
+    // get none share all of them)
+    void split_nodes(size_t n)
+    {
+        if (n == 0) return;
+        std::vector<int> all;
+        for (auto const& node : m_nodes) all.insert(all.end(), node.begin(), node.end());
+        m_nodes.assign(n, {});
+        for (size_t i{}; i < all.size(); ++i) m_nodes[i % n].push_back(all[i]);
+        for (auto& node : m_nodes) {
+            if (node.empty()) node = all;
+        }
+    }
+
+    std::vector<std::vector<int>> m_nodes;
+    bool m_enabled = true;
+};
+
+// Pins the current thread to the CPUs of a NUMA node while it exists, and
+// restores the previous affinity afterwards. Does nothing unless the
+// topology is active.
+class NumaPin
+{
+public:
+    explicit NumaPin([[maybe_unused]] size_t node)
+    {
+#if POLYCUBES_HAVE_AFFINITY
+        auto const& topology = NumaTopology::instance();
+        if (!topology.active()) return;
+
+        if (sched_getaffinity(0, sizeof(m_previous), &m_previous) != 0) return;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : topology.cpus(node)) CPU_SET(cpu, &set);
+        m_pinned = sched_setaffinity(0, sizeof(set), &set) == 0;
+#endif
+    }
+
+    NumaPin(NumaPin const&) = delete;
+    NumaPin& operator=(NumaPin const&) = delete;
+
+    ~NumaPin()
+    {
+#if POLYCUBES_HAVE_AFFINITY
+        if (m_pinned) sched_setaffinity(0, sizeof(m_previous), &m_previous);
+#endif
+    }
+
+private:
+#if POLYCUBES_HAVE_AFFINITY
+    cpu_set_t m_previous{};
+    bool m_pinned = false;
+#endif
+};
+
+#endif // POLYCUBES_NUMA_H_
@@ -0,0 +1,266 @@
+#ifndef POLYCUBES_PERFCOUNTERS_H_
+#define POLYCUBES_PERFCOUNTERS_H_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define POLYCUBES_HAVE_PERF_EVENTS 1
+#else
+#define POLYCUBES_HAVE_PERF_EVENTS 0
+#endif
+
+// Hardware performance counters (Linux perf_event_open), read per thread at
+// the boundaries of the generation phases. Off unless enabled; then every
+// thread opens its own counters the first time it enters a phase.
+
+enum class PerfEvent : size_t
+{
+    cycles,
+    instructions,
+    cache_misses,
+    branch_misses,
+    dtlb_misses,
+    count_
+};
+
+size_t constexpr PERF_EVENT_COUNT = static_cast<size_t>(PerfEvent::count_);
+
+inline char const* perf_event_name(PerfEvent e)
+{
+    static char const* const names[PERF_EVENT_COUNT] = {
+        "cycles", "instructions", "cache-misses", "branch-misses", "dTLB-misses",
+    };
+    return names[static_cast<size_t>(e)];
+}
+
+enum class PerfPhase : size_t
+{
+    search,         // find_larger over the seeds
+    local_merge,    // merging the per-worker result sets
+    disk_merge,     // merging a chunk with the on-disk cache
+    count_
+};
+
+size_t constexpr PERF_PHASE_COUNT = static_cast<size_t>(PerfPhase::count_);
+
+inline char const* perf_phase_name(PerfPhase p)
+{
+    static char const* const names[PERF_PHASE_COUNT] = {"search", "local merge", "disk merge"};
+    return names[static_cast<size_t>(p)];
+}
+
+using PerfValues = std::array<uint64_t, PERF_EVENT_COUNT>;
+using PerfPhaseValues = std::array<PerfValues, PERF_PHASE_COUNT>;
+
+// The counters of one thread. Events the CPU or kernel doesn't support are
+// left out (and read as 0).
+class ThreadPerfCounters
+{
+public:
+    ThreadPerfCounters()
+    {
+        m_fds.fill(-1);
+#if POLYCUBES_HAVE_PERF_EVENTS
+        for (size_t i{}; i < PERF_EVENT_COUNT; ++i) {
+            m_fds[i] = open_event(static_cast<PerfEvent>(i));
+            if (m_fds[i] >= 0) m_available[i] = true;
+            else if (i == 0) m_error = std::strerror(errno);
+        }
+#else
+        m_error = "not supported on this platform";
+#endif
+    }
+
+    ThreadPerfCounters(ThreadPerfCounters const&) = delete;
+    ThreadPerfCounters& operator=(ThreadPerfCounters const&) = delete;
+
+    ~ThreadPerfCounters()
+    {
+#if POLYCUBES_HAVE_PERF_EVENTS
+        for (int fd : m_fds) {
+            if (fd >= 0) close(fd);
+        }
+#endif
+    }
+
+    bool ok() const { return m_available[0]; }
+    bool available(PerfEvent e) const { return m_available[static_cast<size_t>(e)]; }
+    std::string const& error() const { return m_error; }
+
+    // current values, scaled up if the kernel had to multiplex the counters
+    PerfValues read() const
+    {
+        PerfValues result{};
+#if POLYCUBES_HAVE_PERF_EVENTS
+        for (size_t i{}; i < PERF_EVENT_COUNT; ++i) {
+            if (m_fds[i] < 0) continue;
+            uint64_t buf[3]{}; // value, time enabled, time running
+            if (::read(m_fds[i], buf, sizeof(buf)) != sizeof(buf) || buf[2] == 0) continue;
+            result[i] = buf[2] < buf[1] ? uint64_t(double(buf[0]) * double(buf[1]) / double(buf[2])) : buf[0];
+        }
+#endif
+        return result;
+    }
+
+    // accumulated per phase; only written by the owning thread
+    void add(PerfPhase phase, PerfValues const& delta)
+    {
+        auto& values = m_phases[static_cast<size_t>(phase)];
+        for (size_t i{}; i < PERF_EVENT_COUNT; ++i) {
+            values[i].store(values[i].load(std::memory_order_relaxed) + delta[i], std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t get(PerfPhase phase, PerfEvent e) const
+    {
+        return m_phases[static_cast<size_t>(phase)][static_cast<size_t>(e)].load(std::memory_order_relaxed);
+    }
+
+private:
+#if POLYCUBES_HAVE_PERF_EVENTS
+    static int open_event(PerfEvent e)
+    {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        // user space only, so that it works with the default perf_event_paranoid
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        switch (e) {
+        case PerfEvent::cycles:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PerfEvent::instructions:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PerfEvent::cache_misses:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        case PerfEvent::branch_misses:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        case PerfEvent::dtlb_misses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_DTLB
+                | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        default:
+            return -1;
+        }
+        // this thread, any CPU
+        return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+#endif
+
+    std::array<int, PERF_EVENT_COUNT> m_fds;
+    std::array<bool, PERF_EVENT_COUNT> m_available{};
+    std::string m_error;
+    std::array<std::array<std::atomic<uint64_t>, PERF_EVENT_COUNT>, PERF_PHASE_COUNT> m_phases{};
+};
+
+class PerfCounters
+{
+public:
+    static PerfCounters& instance()
+    {
+        static PerfCounters counters;
+        return counters;
+    }
+
+    // Try to open the counters on the calling thread. Returns an empty string
+    // on success, otherwise why it didn't work (and the counters stay off).
+    std::string enable()
+    {
+        auto& local = this->local();
+        if (!local.ok()) return local.error();
+        m_enabled.store(true, std::memory_order_relaxed);
+        return {};
+    }
+
+    bool enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    // whether the calling thread could open this event
+    bool available(PerfEvent e) { return local().available(e); }
+
+    ThreadPerfCounters& local()
+    {
+        thread_local ThreadPerfCounters* counters = [this] {
+            std::unique_lock lock{m_mutex};
+            return m_threads.emplace_back(std::make_unique<ThreadPerfCounters>()).get();
+        }();
+        return *counters;
+    }
+
+    // sum over all threads (including those that have exited)
+    PerfPhaseValues totals() const
+    {
+        PerfPhaseValues result{};
+        std::unique_lock lock{m_mutex};
+        for (auto const& t : m_threads) {
+            for (size_t p{}; p < PERF_PHASE_COUNT; ++p) {
+                for (size_t e{}; e < PERF_EVENT_COUNT; ++e) {
+                    result[p][e] += t->get(static_cast<PerfPhase>(p), static_cast<PerfEvent>(e));
+                }
+            }
+        }
+        return result;
+    }
+
+private:
+    std::atomic<bool> m_enabled{};
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<ThreadPerfCounters>> m_threads;
+};
+
+// Attributes the counts between construction and destruction to a phase
+// (if the counters are enabled)
+class PerfScope
+{
+public:
+    explicit PerfScope(PerfPhase phase) : m_phase{phase}
+    {
+        auto& counters = PerfCounters::instance();
+        if (!counters.enabled()) return;
+        m_local = &counters.local();
+        if (!m_local->ok()) {
+            m_local = nullptr;
+            return;
+        }
+        m_start = m_local->read();
+    }
+
+    PerfScope(PerfScope const&) = delete;
+    PerfScope& operator=(PerfScope const&) = delete;
+
+    ~PerfScope()
+    {
+        if (m_local == nullptr) return;
+        auto end = m_local->read();
+        for (size_t i{}; i < PERF_EVENT_COUNT; ++i) end[i] -= std::min(end[i], m_start[i]);
+        m_local->add(m_phase, end);
+    }
+
+private:
+    PerfPhase m_phase;
+    ThreadPerfCounters* m_local{};
+    PerfValues m_start{};
+};
+
+#endif // POLYCUBES_PERFCOUNTERS_H_
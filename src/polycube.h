@@ -2,10 +2,16 @@
 #define POLYCUBES_POLYCUBE_H_
 
 #include "coord.h"
+#include "cpudispatch.h"
 
 #include <algorithm>
 #include <array>
+#include <cstdint>
+#include <iterator>
+#include <limits>
 #include <ostream>
+#include <span>
+#include <stdexcept>
 
 
 template <size_t SIZE>
@@ -62,6 +68,176 @@ struct PolyCube
 
 };
 
+// number of shapes normalize_batch() works on side by side
+size_t constexpr NORMALIZE_BATCH_LANES = 16;
+
+// Building blocks of the batch kernels (normalize_batch() and
+// classify_symmetry_batch()). The shapes of a batch are kept in a
+// struct-of-arrays layout, coords[axis][cube][lane], so that every step is
+// one loop over NORMALIZE_BATCH_LANES shapes, which the compiler can
+// vectorize regardless of SIZE.
+template <size_t SIZE>
+using BatchCoords = std::array<std::array<std::array<int16_t, NORMALIZE_BATCH_LANES>, SIZE>, 3>;
+
+// a coordinate, packed so that integer order is Coord order
+using BatchKey = uint32_t;
+
+template <size_t SIZE>
+using BatchKeys = std::array<std::array<BatchKey, NORMALIZE_BATCH_LANES>, SIZE>;
+
+// Transposes n shapes into coords; shape(l) returns the cubes of the shape in
+// lane l. Unused lanes repeat the last shape.
+template <size_t SIZE, typename ShapeAt>
+POLYCUBES_ALWAYS_INLINE void batch_load(size_t n, ShapeAt shape, BatchCoords<SIZE>& coords)
+{
+    for (size_t l{}; l < NORMALIZE_BATCH_LANES; ++l) {
+        Coord const* cubes = shape(std::min(l, n - 1));
+        for (size_t i{}; i < SIZE; ++i) {
+            for (int a{}; a < 3; ++a) coords[a][i][l] = cubes[i].xyz[a];
+        }
+    }
+}
+
+// The shapes rotated by perm (after mirroring them at the x = 0 plane if
+// MIRROR), shifted to the origin, packed and sorted. Sorting uses an
+// odd-even transposition network so there are no data-dependent branches.
+template <size_t SIZE, bool MIRROR = false>
+POLYCUBES_ALWAYS_INLINE void batch_rotated_keys(BatchCoords<SIZE> const& coords, AxisPermutation const& perm,
+                                                BatchKeys<SIZE>& keys)
+{
+    size_t constexpr L = NORMALIZE_BATCH_LANES;
+
+    // rotate, shift the minimum to 0 and pack
+    for (auto& k : keys) k.fill(0);
+    for (int a{}; a < 3; ++a) {
+        auto const& src = coords[perm.axis[a]];
+        int16_t const sign = MIRROR && perm.axis[a] == 0 ? -perm.sign[a] : perm.sign[a];
+        int const shift = 8 * (2 - a);
+
+        std::array<int16_t, L> lo;
+        lo.fill(std::numeric_limits<int16_t>::max());
+        for (size_t i{}; i < SIZE; ++i) {
+            for (size_t l{}; l < L; ++l) lo[l] = std::min<int16_t>(lo[l], sign * src[i][l]);
+        }
+        for (size_t i{}; i < SIZE; ++i) {
+            for (size_t l{}; l < L; ++l) keys[i][l] |= BatchKey(sign * src[i][l] - lo[l]) << shift;
+        }
+    }
+
+    // sort the coordinates of every shape
+    for (size_t pass{}; pass < SIZE; ++pass) {
+        for (size_t i = pass % 2; i + 1 < SIZE; i += 2) {
+            for (size_t l{}; l < L; ++l) {
+                auto const k0 = keys[i][l];
+                auto const k1 = keys[i + 1][l];
+                keys[i][l] = std::min(k0, k1);
+                keys[i + 1][l] = std::max(k0, k1);
+            }
+        }
+    }
+}
+
+// per lane: whether a is lexically smaller than b
+template <size_t SIZE>
+POLYCUBES_ALWAYS_INLINE std::array<BatchKey, NORMALIZE_BATCH_LANES> batch_less(BatchKeys<SIZE> const& a,
+                                                                             BatchKeys<SIZE> const& b)
+{
+    std::array<BatchKey, NORMALIZE_BATCH_LANES> less{};
+    for (size_t i = SIZE; i-- > 0; ) {
+        for (size_t l{}; l < NORMALIZE_BATCH_LANES; ++l) {
+            less[l] = (a[i][l] < b[i][l]) | ((a[i][l] == b[i][l]) & less[l]);
+        }
+    }
+    return less;
+}
+
+// per lane: best = min(best, keys)
+template <size_t SIZE>
+POLYCUBES_ALWAYS_INLINE void batch_keep_smaller(BatchKeys<SIZE>& best, BatchKeys<SIZE> const& keys)
+{
+    auto const less = batch_less<SIZE>(keys, best);
+    for (size_t i{}; i < SIZE; ++i) {
+        for (size_t l{}; l < NORMALIZE_BATCH_LANES; ++l) best[i][l] = less[l] ? keys[i][l] : best[i][l];
+    }
+}
+
+template <size_t SIZE>
+POLYCUBES_ALWAYS_INLINE Coord batch_unpack(BatchKeys<SIZE> const& keys, size_t i, size_t l)
+{
+    auto const k = keys[i][l];
+    return Coord{Coord::Scalar(k >> 16), Coord::Scalar((k >> 8) & 0xff), Coord::Scalar(k & 0xff)};
+}
+
+// Normalize many shapes at once: output[i] = input[i].normal()
+//
+// All 24 rotations of NORMALIZE_BATCH_LANES shapes are computed side by side
+// (see batch_rotated_keys), and the smallest one is kept per shape.
+//
+// input and output may be the same span.
+template <size_t SIZE>
+POLYCUBES_ALWAYS_INLINE void normalize_batch_impl(std::span<const PolyCube<SIZE>> input, std::span<PolyCube<SIZE>> output)
+{
+    size_t constexpr L = NORMALIZE_BATCH_LANES;
+    auto const& perms = axis_permutations();
+
+    for (size_t first{}; first < input.size(); first += L) {
+        size_t const n = std::min(L, input.size() - first);
+
+        BatchCoords<SIZE> coords;
+        batch_load<SIZE>(n, [&](size_t l) { return input[first + l].cubes.data(); }, coords);
+
+        BatchKeys<SIZE> best;
+        for (auto& b : best) b.fill(std::numeric_limits<BatchKey>::max());
+        BatchKeys<SIZE> keys;
+        for (auto const& perm : perms) {
+            batch_rotated_keys<SIZE>(coords, perm, keys);
+            batch_keep_smaller<SIZE>(best, keys);
+        }
+
+        for (size_t l{}; l < n; ++l) {
+            auto& s = output[first + l];
+            for (size_t i{}; i < SIZE; ++i) s.cubes[i] = batch_unpack<SIZE>(best, i, l);
+        }
+    }
+}
+
+template <size_t SIZE>
+void normalize_batch_generic(std::span<const PolyCube<SIZE>> input, std::span<PolyCube<SIZE>> output)
+{
+    normalize_batch_impl<SIZE>(input, output);
+}
+
+#if POLYCUBES_X86_DISPATCH
+template <size_t SIZE>
+POLYCUBES_TARGET_AVX2 void normalize_batch_avx2(std::span<const PolyCube<SIZE>> input, std::span<PolyCube<SIZE>> output)
+{
+    normalize_batch_impl<SIZE>(input, output);
+}
+
+template <size_t SIZE>
+POLYCUBES_TARGET_AVX512 void normalize_batch_avx512(std::span<const PolyCube<SIZE>> input, std::span<PolyCube<SIZE>> output)
+{
+    normalize_batch_impl<SIZE>(input, output);
+}
+#endif
+
+// normalize_batch_impl compiled for the best instruction set this CPU supports
+template <size_t SIZE>
+void normalize_batch(std::span<const PolyCube<SIZE>> input, std::span<PolyCube<SIZE>> output)
+{
+    if (output.size() < input.size())
+        throw std::invalid_argument("normalize_batch: output is smaller than input");
+
+    switch (cpu_isa())
+    {
+#if POLYCUBES_X86_DISPATCH
+        case IsaLevel::avx512: return normalize_batch_avx512<SIZE>(input, output);
+        case IsaLevel::avx2: return normalize_batch_avx2<SIZE>(input, output);
+#endif
+        default: return normalize_batch_generic<SIZE>(input, output);
+    }
+}
+
 template <size_t SIZE>
 std::ostream& operator<<(std::ostream& os, PolyCube<SIZE> const& s)
 {
@@ -91,6 +267,18 @@ bool operator<(PolyCube<SIZE> const& a, PolyCube<SIZE> const& b)
     return false;
 }
 
+// Number of (one-sided) polycubes of n cubes (OEIS A000162), for checking results;
+// 0 if unknown
+inline long known_polycube_count(size_t n)
+{
+    static long constexpr counts[] = {
+        1, 1, 2, 8, 29, 166, 1023, 6922, 48311, 346543, 2522522, 18598427,
+        138462649, 1039496297, 7859514470, 59795121480, 457409613979,
+        3516009200564
+    };
+    return n >= 1 && n <= std::size(counts) ? counts[n - 1] : 0;
+}
+
 template<typename T, typename=void> bool constexpr is_polycube = false;
 template<size_t SIZE> bool constexpr is_polycube<PolyCube<SIZE>> = true;
 template<typename T> concept PolyCuboid = is_polycube<T>;
@@ -1,27 +1,208 @@
+#include "cpudispatch.h"
+#include "metrics.h"
+#include "numa.h"
+#include "perfcounters.h"
 #include "polycube.h"
 #include "polycubeio.h"
 #include "polycubesearch.h"
+#include "procstats.h"
+#include "seedorder.h"
 #include "util.h"
 
+#include <chrono>
 #include <cstdlib>
 #include <cerrno>
 #include <filesystem>
 #include <format>
 #include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if POLYCUBES_HAVE_TBB
+#include <tbb/global_control.h>
+#endif
+
+// The largest polycubes generated with the compile-time sized PolyCube<SIZE>;
+// beyond this, the runtime-sized engine is used
+#ifndef POLYCUBES_MAX_STATIC_SIZE
+#define POLYCUBES_MAX_STATIC_SIZE 18
+#endif
+
+struct EscalateOptions
+{
+    bool use_trie = false;
+    bool use_dynamic = false;
+    GeneratorOptions generator{};
+};
 
 template <size_t SIZE>
 struct escalate_impl
 {
-    void operator()(PolyCubeListFileReader& reader, std::filesystem::path& outfile)
+    long operator()(PolyCubeListFileReader& reader, std::filesystem::path& outfile, EscalateOptions const& options)
+    {
+        using Iter = PolyCubeListFileReader::Iter<SIZE>;
+        long count;
+        if (options.use_trie) {
+            count = gen_polycube_list<Iter, PolyCubeTrie<SIZE + 1>>(reader.begin<SIZE>(), reader.end<SIZE>(),
+                                                                  outfile, options.generator);
+        } else {
+            count = gen_polycube_list(reader.begin<SIZE>(), reader.end<SIZE>(), outfile, options.generator);
+        }
+        return count;
+    }
+};
+
+long escalate(PolyCubeListFileReader& reader, std::filesystem::path& outfile, EscalateOptions const& options)
+{
+    size_t constexpr max_static_seed_size = POLYCUBES_MAX_STATIC_SIZE - 1;
+
+    long count;
+    if (options.use_dynamic || options.generator.levels > 1 || (size_t)reader.cube_count() > max_static_seed_size) {
+        count = gen_polycube_list(reader, outfile, options.generator);
+    } else {
+        count = metaswitch<size_t, max_static_seed_size, escalate_impl>{}(reader.cube_count(), reader, outfile, options);
+    }
+    std::cout << std::format("Wrote {} ({})-cubes to {}\n", count, reader.cube_count() + options.generator.levels,
+        outfile.string());
+    return count;
+}
+
+// Limits the number of threads used by the parallel algorithms while it exists
+class ThreadLimit
+{
+public:
+    explicit ThreadLimit([[maybe_unused]] size_t threads)
+#if POLYCUBES_HAVE_TBB
+        : m_control{tbb::global_control::max_allowed_parallelism, threads}
+#endif
     {
-        auto count = gen_polycube_list(reader.begin<SIZE>(), reader.end<SIZE>(), outfile);
-        std::cout << std::format("Wrote {} ({})-cubes to {}\n", count, SIZE + 1, outfile.string());
     }
+
+    static bool supported() { return POLYCUBES_HAVE_TBB; }
+
+private:
+#if POLYCUBES_HAVE_TBB
+    tbb::global_control m_control;
+#endif
 };
 
-void escalate(PolyCubeListFileReader& reader, std::filesystem::path& outfile)
+// Generate one level (seed_file -> outfile) with 1, 2, 4, ... threads, and
+// report how well it scales
+int bench_scaling(std::filesystem::path const& seed_file, std::filesystem::path outfile, EscalateOptions options)
+{
+    struct Run
+    {
+        size_t threads{};
+        double wall{};
+        ProcessStats before{}, after{};
+        GeneratorTimings timings{};
+        long count{};
+    };
+
+    size_t const max_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<size_t> thread_counts;
+    if (ThreadLimit::supported()) {
+        for (size_t t = 1; t < max_threads; t *= 2) thread_counts.push_back(t);
+    } else {
+        std::cerr << "WARNING: can't limit the number of threads in this build; only timing all threads\n";
+    }
+    thread_counts.push_back(max_threads);
+
+    size_t cube_count = PolyCubeListFileReader{seed_file}.cube_count() + options.generator.levels;
+    std::vector<Run> runs;
+
+    for (auto threads : thread_counts) {
+        std::cout << std::format("=== ({})-cubes with {} thread(s) ===\n", cube_count, threads);
+        ThreadLimit limit{threads};
+        Run run{.threads = threads};
+        options.generator.timings = &run.timings;
+
+        ProcessStats::reset_peak_rss();
+        run.before = ProcessStats::now();
+        auto t0 = std::chrono::steady_clock::now();
+        {
+            PolyCubeListFileReader reader{seed_file};
+            run.count = escalate(reader, outfile, options);
+        }
+        run.wall = seconds_between(t0, std::chrono::steady_clock::now());
+        run.after = ProcessStats::now();
+        runs.push_back(run);
+    }
+
+    // Check the result against the known number of polycubes
+    auto expected = options.generator.box.unconstrained() ? known_polycube_count(cube_count) : 0;
+    bool all_ok = true;
+
+    auto mb = [](long before, long after) {
+        return before < 0 || after < 0 ? -1.0 : double(after - before) / 1e6;
+    };
+
+    std::cout << std::format("\nScaling of ({})-cubes from {}:\n", cube_count, seed_file.string());
+    std::cout << std::format("{:>7} {:>9} {:>7} {:>6} {:>6} {:>9} {:>9} {:>9} {:>9} {:>9} {:>9}  {}\n",
+        "threads", "wall[s]", "speedup", "eff", "cpu%", "rss[MB]", "read[MB]", "write[MB]",
+        "search[s]", "merge[s]", "wait[s]", "count");
+    for (auto const& run : runs) {
+        double speedup = runs.front().wall / run.wall;
+        double cpu = run.after.cpu_seconds - run.before.cpu_seconds;
+        std::string check = expected == 0 ? "" : run.count == expected ? " ok" : std::format(" WRONG (expected {})", expected);
+        all_ok = all_ok && (expected == 0 || run.count == expected);
+
+        std::cout << std::format("{:>7} {:>9.3f} {:>7.2f} {:>5.0f}% {:>5.0f}% {:>9.1f} {:>9.1f} {:>9.1f} {:>9.3f} {:>9.3f} {:>9.3f}  {}{}\n",
+            run.threads, run.wall, speedup, 100.0 * speedup / (double)run.threads,
+            100.0 * cpu / run.wall, run.after.peak_rss_kb / 1024.0,
+            mb(run.before.read_bytes, run.after.read_bytes), mb(run.before.written_bytes, run.after.written_bytes),
+            run.timings.compute, run.timings.merge, run.timings.wait, run.count, check);
+    }
+
+    return all_ok ? 0 : 1;
+}
+
+void print_symmetry_stats(size_t count, SymmetryStats const& stats, double seconds)
+{
+    std::string orders;
+    for (auto const& [order, n] : stats.orders) {
+        orders += std::format(" {}:{}", order, n);
+    }
+    std::cout << std::format("({})-cubes: {} one-sided, {} free, {} achiral; symmetry group orders{} "
+                             "(classified in {:.2f} s)\n",
+        count, stats.one_sided, stats.free, stats.achiral, orders, seconds);
+}
+
+void print_duplicate_stats(size_t count, GeneratorDuplicates const& d)
 {
-    metaswitch<size_t, 17, escalate_impl>{}(reader.cube_count(), reader, outfile);
+    std::cout << std::format("({})-cubes: {} chunks, {} candidates; duplicates removed {:.1f}% within chunks, "
+                             "{:.1f}% across chunks (disk merge)\n",
+        count, d.chunks, d.candidates, 100.0 * d.in_chunk_rate(), 100.0 * d.cross_chunk_rate());
+}
+
+// hardware counters per phase between two PerfCounters::totals()
+void print_perf_counters(size_t count, PerfPhaseValues const& before, PerfPhaseValues const& after)
+{
+    auto& counters = PerfCounters::instance();
+    std::cout << std::format("({})-cubes: hardware counters\n", count);
+    std::cout << std::format("  {:<12}", "phase");
+    for (size_t e{}; e < PERF_EVENT_COUNT; ++e) {
+        std::cout << std::format(" {:>16}", perf_event_name(static_cast<PerfEvent>(e)));
+    }
+    std::cout << std::format(" {:>6}\n", "IPC");
+
+    for (size_t p{}; p < PERF_PHASE_COUNT; ++p) {
+        PerfValues delta{};
+        for (size_t e{}; e < PERF_EVENT_COUNT; ++e) delta[e] = after[p][e] - before[p][e];
+
+        std::cout << std::format("  {:<12}", perf_phase_name(static_cast<PerfPhase>(p)));
+        for (size_t e{}; e < PERF_EVENT_COUNT; ++e) {
+            if (counters.available(static_cast<PerfEvent>(e))) {
+                std::cout << std::format(" {:>16}", delta[e]);
+            } else {
+                std::cout << std::format(" {:>16}", "n/a");
+            }
+        }
+        auto cycles = delta[static_cast<size_t>(PerfEvent::cycles)];
+        auto instructions = delta[static_cast<size_t>(PerfEvent::instructions)];
+        std::cout << std::format(" {:>6.2f}\n", cycles == 0 ? 0.0 : double(instructions) / double(cycles));
+    }
 }
 
 int main(int argc, char const* const* argv)
@@ -31,6 +212,16 @@ int main(int argc, char const* const* argv)
     size_t maxcount = 6;
     std::filesystem::path out_dir{"."};
     std::filesystem::path seed_file;
+    EscalateOptions options;
+    bool count_symmetries = false;
+    bool write_free = false;
+    bool scaling_benchmark = false;
+    std::filesystem::path metrics_file;
+    double metrics_interval = 10;
+    bool perf_counters = false;
+    // the last levels up to maxcount are generated depth first
+    size_t depth_first_levels = 1;
+    bool group_seeds = false;
 
     for (int i{1}; i < argc; ++i) {
         std::string_view arg{argv[i]};
@@ -49,28 +240,158 @@ int main(int argc, char const* const* argv)
             }
         } else if ((arg == "-s"sv || arg == "--seed"sv) && i + 1 < argc) {
             seed_file = argv[++i];
+        } else if (arg == "--trie"sv) {
+            options.use_trie = true;
+        } else if (arg == "--dynamic"sv) {
+            options.use_dynamic = true;
+        } else if (arg == "--box"sv && i + 1 < argc) {
+            try {
+                options.generator.box = BoxConstraint::parse(argv[++i]);
+            } catch (std::invalid_argument const& e) {
+                std::cerr << "ERROR: " << e.what() << '\n';
+                return 2;
+            }
+        } else if (arg == "--metrics"sv && i + 1 < argc) {
+            metrics_file = argv[++i];
+        } else if (arg == "--metrics-interval"sv && i + 1 < argc) {
+            metrics_interval = std::strtod(argv[++i], nullptr);
+            if (!(metrics_interval > 0)) {
+                std::cerr << "ERROR: metrics interval must be positive!\n";
+                return 2;
+            }
+        } else if (arg == "--no-numa"sv) {
+            NumaTopology::instance().set_enabled(false);
+        } else if (arg == "--perf-counters"sv) {
+            perf_counters = true;
+        } else if (arg == "--depth-first"sv && i + 1 < argc) {
+            long val = strtol(argv[++i], nullptr, 10);
+            if (val <= 0) {
+                std::cerr << "ERROR: depth-first levels must be positive!\n";
+                return 2;
+            }
+            depth_first_levels = static_cast<size_t>(val);
+        } else if (arg == "--group-seeds"sv) {
+            group_seeds = true;
+        } else if (arg == "--chunk-seeds"sv && i + 1 < argc) {
+            options.generator.chunk_seeds = std::strtol(argv[++i], nullptr, 10);
+            if (options.generator.chunk_seeds <= 0) {
+                std::cerr << "ERROR: chunk size must be positive!\n";
+                return 2;
+            }
+        } else if (arg == "--bench-scaling"sv) {
+            scaling_benchmark = true;
+        } else if (arg == "--symmetry"sv) {
+            count_symmetries = true;
+        } else if (arg == "--free"sv) {
+            count_symmetries = true;
+            write_free = true;
         } else if (arg == "-h"sv || arg == "--help"sv) {
-            std::cout << std::format("Usage: {} [-n MAXCOUNT] [-s SEED_FILE] [OUTDIR]\n", argv[0]);
+            std::cout << std::format("Usage: {} [-n MAXCOUNT] [-s SEED_FILE] [--trie] [--dynamic] "
+                                     "[--box AxBxC] [--depth-first LEVELS] [--group-seeds] [--chunk-seeds N] "
+                                     "[--symmetry] [--free] [--bench-scaling] "
+                                     "[--metrics FILE] [--metrics-interval SECONDS] [--perf-counters] [--no-numa] [OUTDIR]\n", argv[0]);
             return 0;
         } else {
             out_dir = arg;
         }
     }
 
+    std::cout << std::format("Using {} kernels\n", isa_name(cpu_isa()));
+    if (auto const& numa = NumaTopology::instance(); numa.active()) {
+        std::cout << std::format("Using {} NUMA nodes\n", numa.node_count());
+    }
+
+    // always running, so that SIGUSR1 dumps the counters even without --metrics
+    MetricsReporter metrics{metrics_file, metrics_interval};
+
+    if (perf_counters) {
+        if (auto error = PerfCounters::instance().enable(); !error.empty()) {
+            std::cout << "WARNING: hardware performance counters are not available (" << error
+                << "); continuing without them\n";
+            perf_counters = false;
+        }
+    }
+
     if (seed_file.empty()) {
         seed_file = out_dir/"polycubes_1.bin";
         PolyCubeListFileWriter<1> writer{seed_file};
         writer.write({Coord{0, 0, 0}});
     }
 
+    // constrained results are named differently so they don't get mixed up
+    // with complete lists
+    std::string suffix;
+    if (auto const& box = options.generator.box; !box.unconstrained()) {
+        suffix = std::format("_box{}x{}x{}", box.dims[0], box.dims[1], box.dims[2]);
+    }
+
+    auto outfile_for = [&](size_t count) {
+        return out_dir / std::format("polycubes_{}{}.bin", count, suffix);
+    };
+
+    auto seed_cube_count = [&] { return (size_t)PolyCubeListFileReader{seed_file}.cube_count(); };
+
+    // levels to add to seed_file in the next step: the last depth_first_levels
+    // levels up to maxcount are done in one step
+    auto levels_for_next_step = [&] {
+        auto seed_count = seed_cube_count();
+        return seed_count + depth_first_levels >= maxcount && maxcount > seed_count ? maxcount - seed_count : 1;
+    };
+
+    // generate the next level(s) from seed_file, returns the cube count
+    auto next_level = [&](size_t levels) {
+        // the seeds in the order they are expanded in
+        auto order_file = seed_file;
+        if (group_seeds) {
+            order_file = out_dir / std::format(".{}.grouped.tmp", seed_file.filename().string());
+            write_grouped_seeds(seed_file, order_file);
+        }
+
+        size_t count{};
+        GeneratorDuplicates duplicates;
+        {
+            PolyCubeListFileReader reader{order_file};
+            count = reader.cube_count() + levels;
+            options.generator.levels = levels;
+            auto outfile = outfile_for(count);
+            metrics.set_level(count);
+
+            SymmetryStats symmetry_stats;
+            GeneratorTimings timings;
+            if (count_symmetries) {
+                options.generator.symmetry_stats = &symmetry_stats;
+                options.generator.timings = &timings;
+            }
+            if (write_free) options.generator.free_outfile = out_dir / std::format("polycubes_{}{}_free.bin", count, suffix);
+            options.generator.duplicates = &duplicates;
+
+            auto perf_before = PerfCounters::instance().totals();
+            escalate(reader, outfile, options);
+            options.generator.symmetry_stats = nullptr;
+            options.generator.timings = nullptr;
+            options.generator.duplicates = nullptr;
+            if (count_symmetries) print_symmetry_stats(count, symmetry_stats, timings.classify);
+            if (perf_counters) print_perf_counters(count, perf_before, PerfCounters::instance().totals());
+        }
+        if (group_seeds) std::filesystem::remove(order_file);
+        if (group_seeds || duplicates.chunks > 1) print_duplicate_stats(count, duplicates);
+        seed_file = outfile_for(count);
+        return count;
+    };
+
+    if (scaling_benchmark) {
+        // generate the seeds normally, then time the last level(s)
+        while (levels_for_next_step() == 1 && seed_cube_count() + 1 < maxcount) next_level(1);
+        options.generator.free_outfile.clear();
+        options.generator.levels = levels_for_next_step();
+        auto outfile = outfile_for(seed_cube_count() + options.generator.levels);
+        return bench_scaling(seed_file, outfile, options);
+    }
+
     size_t count{};
 
     do {
-        PolyCubeListFileReader reader{seed_file};
-        count = reader.cube_count() + 1;
-        auto outfile = out_dir / std::format("polycubes_{}.bin", count);
-        escalate(reader, outfile);
-        seed_file = outfile;
+        count = next_level(levels_for_next_step());
     } while (count < maxcount);
 
     return 0;
@@ -0,0 +1,178 @@
+#ifndef POLYCUBES_POLYCUBEINDEX_H_
+#define POLYCUBES_POLYCUBEINDEX_H_
+
+#include "dynpolycube.h"
+#include "polycubeio.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+// Membership and rank queries on a (sorted) polycube list file. A sparse
+// index of every STRIDE-th shape is kept in memory, so a query reads at most
+// one block of STRIDE shapes from the list. The index is stored next to the
+// list (FILE.idx) and rebuilt when it is missing or out of date.
+//
+// Index file format: "PLYCIDX1", int32 cube count, uint32 stride, uint64
+// number of shapes in the list, then every stride-th shape of the list.
+
+struct PolyCubeLookup
+{
+    bool found;
+    // the index of the shape in the list if found, otherwise the number of
+    // shapes in the list that are smaller (where it would be inserted)
+    size_t index;
+};
+
+class PolyCubeIndex
+{
+public:
+    static uint32_t constexpr STRIDE = 4096;
+
+    explicit PolyCubeIndex(std::filesystem::path const& list_file)
+        : m_list_file{list_file},
+          m_reader{list_file},
+          m_keys{(size_t)m_reader.cube_count()},
+          m_block{(size_t)m_reader.cube_count()}
+    {
+        auto index_file = index_path_for(list_file);
+        if (!load(index_file)) {
+            build();
+            save(index_file);
+        }
+    }
+
+    static std::filesystem::path index_path_for(std::filesystem::path const& list_file)
+    {
+        auto result = list_file;
+        result += ".idx";
+        return result;
+    }
+
+    size_t size() const { return m_reader.size(); }
+    size_t cube_count() const { return m_keys.cube_count(); }
+
+    // number of blocks read from the list so far
+    size_t block_reads() const { return m_block_reads; }
+
+    // look up a shape in any orientation and position
+    PolyCubeLookup find(std::span<const Coord> shape)
+    {
+        if (shape.size() != cube_count()) throw std::invalid_argument("wrong number of cubes");
+        std::array<Coord, MAX_CUBE_COUNT> buf;
+        auto normal = std::span{buf}.first(shape.size());
+        normalize(shape, normal);
+        return find_normal(DynPolyCube{normal});
+    }
+
+    // look up a shape that is already normalized
+    PolyCubeLookup find_normal(DynPolyCube const& shape)
+    {
+        if (size() == 0) return {false, 0};
+
+        // the block that would contain it: the last one whose first shape isn't larger
+        auto block = partition_point(m_keys, [&](DynPolyCube const& key) { return !(shape < key); });
+        if (block == 0) return {false, 0};
+        --block;
+
+        load_block(block);
+        auto i = partition_point(m_block, [&](DynPolyCube const& s) { return s < shape; });
+        bool found = i < m_block.size() && m_block[i] == shape;
+        return {found, block * STRIDE + i};
+    }
+
+private:
+    bool load(std::filesystem::path const& index_file)
+    {
+        std::error_code ec;
+        auto index_time = std::filesystem::last_write_time(index_file, ec);
+        if (ec) return false;
+        // the index has to be newer than the list
+        if (index_time < std::filesystem::last_write_time(m_list_file, ec) || ec) return false;
+
+        std::ifstream in{index_file, std::ios::binary | std::ios::in};
+        std::string magic(8, '\0');
+        int32_t cube_count{};
+        uint32_t stride{};
+        uint64_t shape_count{};
+        in.read(magic.data(), 8);
+        in.read(reinterpret_cast<char*>(&cube_count), sizeof(cube_count));
+        in.read(reinterpret_cast<char*>(&stride), sizeof(stride));
+        in.read(reinterpret_cast<char*>(&shape_count), sizeof(shape_count));
+        if (!in || magic != "PLYCIDX1" || cube_count != m_reader.cube_count() || stride != STRIDE
+            || shape_count != size()) {
+            return false;
+        }
+
+        m_keys.resize(key_count());
+        in.read(reinterpret_cast<char*>(m_keys.data()), (std::streamsize)(m_keys.size() * cube_count * sizeof(Coord)));
+        return (bool)in;
+    }
+
+    void build()
+    {
+        m_keys.clear();
+        for (size_t i{}; i < size(); i += STRIDE) {
+            m_reader.read(i, 1, m_block);
+            m_keys.push_back(m_block[0].cubes);
+        }
+        m_block_index = NO_BLOCK;
+    }
+
+    void save(std::filesystem::path const& index_file) const
+    {
+        // best effort: without write access, the index is just rebuilt next time
+        std::ofstream out{index_file, std::ios::binary | std::ios::out | std::ios::trunc};
+        if (!out) return;
+        int32_t cube_count = m_reader.cube_count();
+        uint32_t stride = STRIDE;
+        uint64_t shape_count = size();
+        out.write("PLYCIDX1", 8);
+        out.write(reinterpret_cast<char const*>(&cube_count), sizeof(cube_count));
+        out.write(reinterpret_cast<char const*>(&stride), sizeof(stride));
+        out.write(reinterpret_cast<char const*>(&shape_count), sizeof(shape_count));
+        out.write(reinterpret_cast<char const*>(m_keys.data()), (std::streamsize)(m_keys.size() * cube_count * sizeof(Coord)));
+    }
+
+    // the first index in shapes for which pred is false (pred must be true
+    // for a prefix of shapes)
+    template <typename Pred>
+    static size_t partition_point(PolyCubeArena const& shapes, Pred pred)
+    {
+        size_t lo{}, hi{shapes.size()};
+        while (lo < hi) {
+            auto mid = lo + (hi - lo) / 2;
+            if (pred(shapes[mid])) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    size_t key_count() const { return (size() + STRIDE - 1) / STRIDE; }
+
+    void load_block(size_t block)
+    {
+        if (block == m_block_index) return;
+        auto first = block * STRIDE;
+        m_reader.read(first, std::min<size_t>(STRIDE, size() - first), m_block);
+        m_block_index = block;
+        ++m_block_reads;
+    }
+
+    static size_t constexpr NO_BLOCK = std::numeric_limits<size_t>::max();
+
+    std::filesystem::path m_list_file;
+    PolyCubeListFileReader m_reader;
+    PolyCubeArena m_keys;
+    PolyCubeArena m_block;
+    size_t m_block_index{NO_BLOCK};
+    size_t m_block_reads{};
+};
+
+#endif // POLYCUBES_POLYCUBEINDEX_H_
@@ -1,8 +1,12 @@
 #ifndef POLYCUBES_POLYCUBEIO_H_
 #define POLYCUBES_POLYCUBEIO_H_
 
+#include "dynpolycube.h"
+#include "mappedfile.h"
+#include "metrics.h"
 #include "polycube.h"
 
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <memory>
@@ -10,6 +14,8 @@
 class PolyCubeListFileReader
 {
     static size_t constexpr PAGE_SIZE = 10'000'000;
+    // number of shapes DynIter reads at once
+    static size_t constexpr DYN_BLOCK_SIZE = 1'000'000;
 
     template<size_t SIZE>
     struct Page
@@ -46,6 +52,96 @@ public:
     }
 
     int cube_count() const { return m_cube_count; }
+    size_t size() const { return m_polycube_count; }
+
+    // Read count shapes starting at first into out (runtime-sized access)
+    void read(size_t first, size_t count, PolyCubeArena& out)
+    {
+        if (out.cube_count() != (size_t)m_cube_count) throw std::invalid_argument("cube count mismatch");
+        if (first + count > m_polycube_count) throw std::out_of_range("read past the end of the file");
+
+        auto const shape_bytes = m_cube_count * sizeof(Coord);
+        out.resize(count);
+        ScopedTimer timer{Metric::read_ns};
+        m_stream->seekg(m_begin_pos + (std::streamoff)(first * shape_bytes));
+        m_stream->read(reinterpret_cast<char*>(out.data()), count * shape_bytes);
+        if (!m_stream->good()) throw std::runtime_error("Error reading file");
+        thread_metrics().add(Metric::read_bytes, count * shape_bytes);
+    }
+
+    // Sequential iterator for runtime-sized shapes
+    class DynIter
+    {
+    public:
+        using value_type = DynPolyCube;
+        using reference = value_type const&;
+        using pointer = value_type const*;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        DynIter() = default;
+
+        DynIter(PolyCubeListFileReader* parent, size_t pos)
+            : m_parent{parent}, m_pos{pos}
+        {
+            if (m_pos < m_parent->size()) load();
+        }
+
+        reference operator*() const { return m_current; }
+        pointer operator->() const { return &m_current; }
+
+        DynIter& operator++()
+        {
+            ++m_pos;
+            if (m_pos < m_parent->size()) {
+                if (m_pos - m_block_begin < m_block->size()) {
+                    m_current = (*m_block)[m_pos - m_block_begin];
+                } else {
+                    load();
+                }
+            }
+            return *this;
+        }
+
+        DynIter operator++(int)
+        {
+            auto copy = *this;
+            ++(*this);
+            return copy;
+        }
+
+        bool operator==(DynIter const& other) const
+        {
+            return m_parent == other.m_parent && m_pos == other.m_pos;
+        }
+
+        bool operator!=(DynIter const& other) const { return !(*this == other); }
+
+    private:
+        void load()
+        {
+            auto count = std::min(DYN_BLOCK_SIZE, m_parent->size() - m_pos);
+            m_block = std::make_shared<PolyCubeArena>(m_parent->cube_count());
+            m_parent->read(m_pos, count, *m_block);
+            m_block_begin = m_pos;
+            m_current = (*m_block)[0];
+        }
+
+        PolyCubeListFileReader* m_parent{};
+        size_t m_pos{};
+        std::shared_ptr<PolyCubeArena> m_block;
+        size_t m_block_begin{};
+        DynPolyCube m_current{};
+    };
+
+    struct DynRangeAdapter
+    {
+        DynIter begin() { return DynIter{self, 0}; }
+        DynIter end() { return DynIter{self, self->size()}; }
+        PolyCubeListFileReader* self;
+    };
+
+    DynRangeAdapter dyn_range() { return {this}; }
 
     template <size_t SIZE>
     class Iter
@@ -199,11 +295,15 @@ private:
             auto const page_start = m_begin_pos + page_idx * (long)page_bytes;
             auto const actual_page_len = std::min(m_end_pos - page_start, (long)page_bytes);
             auto const actual_shape_count = actual_page_len / sizeof(PolyCube<SIZE>);
-            m_stream->seekg(page_start);
             auto result = std::make_shared<Page<SIZE>>();
             result->index = page_idx;
             result->shapes.resize(actual_shape_count);
-            m_stream->read(reinterpret_cast<char*>(result->shapes.data()), actual_page_len);
+            {
+                ScopedTimer timer{Metric::read_ns};
+                m_stream->seekg(page_start);
+                m_stream->read(reinterpret_cast<char*>(result->shapes.data()), actual_page_len);
+            }
+            thread_metrics().add(Metric::read_bytes, actual_page_len);
             m_pages[page_idx] = result;
             return result;
         } else {
@@ -253,8 +353,10 @@ public:
 private:
     void flush()
     {
-        m_stream->write(reinterpret_cast<char const*>(m_wbuf.data()),
-                        m_wbuf.size() * sizeof(PolyCube<SIZE>));
+        ScopedTimer timer{Metric::write_ns};
+        auto const bytes = m_wbuf.size() * sizeof(PolyCube<SIZE>);
+        m_stream->write(reinterpret_cast<char const*>(m_wbuf.data()), bytes);
+        thread_metrics().add(Metric::write_bytes, bytes);
         m_wbuf.clear();
     }
 
@@ -262,4 +364,85 @@ private:
     std::vector<PolyCube<SIZE>> m_wbuf;
 };
 
+// Writer for runtime-sized shapes, producing the same format
+class DynPolyCubeListFileWriter
+{
+    static size_t constexpr WRITE_BUF_SIZE = 1000'000;
+public:
+    DynPolyCubeListFileWriter(std::filesystem::path const& path, size_t cube_count)
+        : m_stream{std::make_unique<std::ofstream>(path, std::ios::binary | std::ios::trunc | std::ios::out)},
+          m_cube_count{cube_count}
+    {
+        static_assert(std::endian::native == std::endian::little);
+        const int32_t size = (int32_t)cube_count;
+        m_stream->write("PLYCUBE1", 8);
+        m_stream->write(reinterpret_cast<char const*>(&size), sizeof(int32_t));
+    }
+
+    void write(DynPolyCube const& s)
+    {
+        m_wbuf.insert(m_wbuf.end(), s.cubes.begin(), s.cubes.end());
+        if (m_wbuf.size() >= WRITE_BUF_SIZE * m_cube_count) flush();
+    }
+
+    ~DynPolyCubeListFileWriter()
+    {
+        flush();
+    }
+private:
+    void flush()
+    {
+        ScopedTimer timer{Metric::write_ns};
+        auto const bytes = m_wbuf.size() * sizeof(Coord);
+        m_stream->write(reinterpret_cast<char const*>(m_wbuf.data()), bytes);
+        thread_metrics().add(Metric::write_bytes, bytes);
+        m_wbuf.clear();
+    }
+
+    std::unique_ptr<std::ostream> m_stream{};
+    size_t m_cube_count;
+    std::vector<Coord> m_wbuf;
+};
+
+// A polycube list file mapped into memory, for random access from several
+// threads at once
+class MappedPolyCubeList
+{
+public:
+    // size of the file header (magic and cube count)
+    static size_t constexpr HEADER_SIZE = 8 + sizeof(int32_t);
+
+    explicit MappedPolyCubeList(std::filesystem::path const& path) : m_file{path}
+    {
+        auto bytes = m_file.bytes();
+        if (bytes.size() < HEADER_SIZE || std::memcmp(bytes.data(), "PLYCUBE1", 8) != 0) {
+            throw std::runtime_error("Invalid file format");
+        }
+        int32_t cube_count{};
+        std::memcpy(&cube_count, bytes.data() + 8, sizeof(cube_count));
+        if (cube_count <= 0 || (size_t)cube_count > MAX_CUBE_COUNT) throw std::runtime_error("Invalid cube count");
+        m_cube_count = (size_t)cube_count;
+        m_coords = reinterpret_cast<Coord const*>(bytes.data() + HEADER_SIZE);
+        m_size = (bytes.size() - HEADER_SIZE) / (m_cube_count * sizeof(Coord));
+        m_trailing_bytes = (bytes.size() - HEADER_SIZE) % (m_cube_count * sizeof(Coord));
+    }
+
+    size_t cube_count() const { return m_cube_count; }
+    size_t size() const { return m_size; }
+    // bytes at the end that don't make up a whole shape
+    size_t trailing_bytes() const { return m_trailing_bytes; }
+
+    DynPolyCube operator[](size_t i) const
+    {
+        return {std::span{m_coords + i * m_cube_count, m_cube_count}};
+    }
+
+private:
+    MappedFile m_file;
+    size_t m_cube_count{};
+    size_t m_size{};
+    size_t m_trailing_bytes{};
+    Coord const* m_coords{};
+};
+
 #endif // POLYCUBES_POLYCUBEIO_H_
@@ -0,0 +1,296 @@
+#include "dynpolycube.h"
+#include "polycubeio.h"
+#include "util.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <execution>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+// Merges sorted polycube lists of the same size into their union (without
+// duplicates), or the shapes of the first list that are in none of the others
+// (--difference), or the shapes that are in all of them (--intersection).
+//
+// The key space is split at splitters sampled from the inputs, so that every
+// input splits into the same ranges. The ranges are merged in parallel twice:
+// once to count the output of every range, and then to write every range at
+// its own offset in the output file.
+
+enum class MergeOp
+{
+    union_,
+    difference,
+    intersection,
+};
+
+// samples taken from every input per output range, to choose the splitters
+size_t constexpr SAMPLES_PER_RANGE = 16;
+
+// Merges the ranges [begins[i], ends[i]) of the inputs, like merge_uniq, but
+// keeping track of which inputs every shape is in
+template <typename OutFunc>
+void merge_sets(std::vector<std::unique_ptr<MappedPolyCubeList>> const& inputs,
+    std::span<const size_t> begins, std::span<const size_t> ends, MergeOp op, OutFunc f)
+{
+    std::vector<size_t> pos(begins.begin(), begins.end());
+    for (;;) {
+        DynPolyCube minval{};
+        bool found = false;
+        for (size_t i{}; i < inputs.size(); ++i) {
+            if (pos[i] == ends[i]) continue;
+            auto val = (*inputs[i])[pos[i]];
+            if (!found || val < minval) {
+                minval = val;
+                found = true;
+            }
+        }
+
+        if (!found) break; // eof
+
+        // skip the shape in every input that has it
+        bool in_first = false;
+        size_t count{};
+        for (size_t i{}; i < inputs.size(); ++i) {
+            if (pos[i] != ends[i] && (*inputs[i])[pos[i]] == minval) {
+                ++pos[i];
+                ++count;
+                if (i == 0) in_first = true;
+            }
+        }
+
+        bool keep = op == MergeOp::union_
+            || (op == MergeOp::difference && in_first && count == 1)
+            || (op == MergeOp::intersection && count == inputs.size());
+        if (keep) f(minval);
+    }
+}
+
+// The first shape in [begin, end) that is not larger than the shape before it
+// (the one before begin too), or end if the shapes are strictly increasing
+size_t first_unordered(MappedPolyCubeList const& in, size_t begin, size_t end)
+{
+    for (size_t j = std::max<size_t>(begin, 1); j < end; ++j) {
+        if (!(in[j - 1] < in[j])) return j;
+    }
+    return end;
+}
+
+// Splits the inputs into about range_count ranges of shapes. Returns the start
+// index of every range in every input: bounds[r][i], with one more entry
+// for the ends.
+std::vector<std::vector<size_t>> partition_inputs(
+    std::vector<std::unique_ptr<MappedPolyCubeList>> const& inputs, size_t range_count)
+{
+    // sample the inputs evenly
+    PolyCubeArena samples{inputs[0]->cube_count()};
+    for (auto const& in : inputs) {
+        auto const n = std::min(in->size(), range_count * SAMPLES_PER_RANGE);
+        for (size_t k{}; k < n; ++k) samples.push_back((*in)[k * in->size() / n].cubes);
+    }
+    samples.sort_unique();
+
+    std::vector<size_t> splitters;
+    for (size_t r{1}; r < range_count; ++r) {
+        auto const s = r * samples.size() / range_count;
+        if (s != 0 && (splitters.empty() || splitters.back() != s)) splitters.push_back(s);
+    }
+
+    std::vector<std::vector<size_t>> bounds;
+    std::vector<size_t> b(inputs.size(), 0);
+    bounds.push_back(b);
+    for (auto s : splitters) {
+        auto const splitter = samples[s];
+        for (size_t i{}; i < inputs.size(); ++i) {
+            // the first shape that is not smaller than the splitter
+            auto const& in = *inputs[i];
+            size_t lo{}, hi{in.size()};
+            while (lo < hi) {
+                auto mid = lo + (hi - lo) / 2;
+                if (in[mid] < splitter) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            b[i] = lo;
+        }
+        bounds.push_back(b);
+    }
+    for (size_t i{}; i < inputs.size(); ++i) b[i] = inputs[i]->size();
+    bounds.push_back(b);
+    return bounds;
+}
+
+// Writes the merged ranges to outfile, each range in parallel at its offset;
+// throws std::runtime_error if any write fails
+void write_ranges(std::vector<std::unique_ptr<MappedPolyCubeList>> const& inputs,
+                  std::vector<std::vector<size_t>> const& bounds, std::vector<size_t> const& offsets,
+                  std::filesystem::path const& outfile, MergeOp op)
+{
+    auto const cube_count = inputs[0]->cube_count();
+    std::vector<size_t> indices(bounds.size() - 1);
+    std::iota(indices.begin(), indices.end(), 0);
+
+    // header and the full size, then every range writes its own part
+    {
+        DynPolyCubeListFileWriter header{outfile, cube_count};
+    }
+    if (std::filesystem::file_size(outfile) != MappedPolyCubeList::HEADER_SIZE) {
+        throw std::runtime_error(std::format("Error writing {}", outfile.string()));
+    }
+    auto const shape_bytes = cube_count * sizeof(Coord);
+    std::filesystem::resize_file(outfile, MappedPolyCubeList::HEADER_SIZE + offsets.back() * shape_bytes);
+
+    std::atomic<bool> write_failed{false};
+    std::for_each(std::execution::par, indices.begin(), indices.end(), [&](size_t r) {
+        std::fstream out{outfile, std::ios::binary | std::ios::in | std::ios::out};
+        out.seekp((std::streamoff)(MappedPolyCubeList::HEADER_SIZE + offsets[r] * shape_bytes));
+        if (!out) {
+            write_failed = true;
+            return;
+        }
+
+        std::vector<Coord> buf;
+        auto flush = [&] {
+            out.write(reinterpret_cast<char const*>(buf.data()), (std::streamsize)(buf.size() * sizeof(Coord)));
+            buf.clear();
+        };
+        merge_sets(inputs, bounds[r], bounds[r + 1], op, [&](DynPolyCube const& s) {
+            buf.insert(buf.end(), s.cubes.begin(), s.cubes.end());
+            if (buf.size() >= 1000'000) flush();
+        });
+        flush();
+        // the stream state is sticky, so this also catches failed writes above
+        out.close();
+        if (!out) write_failed = true;
+    });
+
+    if (write_failed) throw std::runtime_error(std::format("Error writing {}", outfile.string()));
+}
+
+size_t merge_files(std::vector<std::filesystem::path> const& infiles, std::filesystem::path const& outfile, MergeOp op)
+{
+    std::vector<std::unique_ptr<MappedPolyCubeList>> inputs;
+    for (auto const& f : infiles) {
+        inputs.push_back(std::make_unique<MappedPolyCubeList>(f));
+        if (inputs.back()->cube_count() != inputs[0]->cube_count()) {
+            throw std::invalid_argument(std::format("{} has {}-cubes, {} has {}-cubes", infiles[0].string(),
+                inputs[0]->cube_count(), f.string(), inputs.back()->cube_count()));
+        }
+        if (inputs.back()->trailing_bytes() != 0) {
+            throw std::invalid_argument(std::format("{} has a truncated shape at the end", f.string()));
+        }
+    }
+
+    size_t total_input{};
+    for (auto const& in : inputs) total_input += in->size();
+    size_t const range_count = std::max<size_t>(1, std::min<size_t>(
+        4 * std::max(1u, std::thread::hardware_concurrency()), total_input / 65536));
+    auto const bounds = partition_inputs(inputs, range_count);
+    auto const ranges = bounds.size() - 1;
+
+    std::vector<size_t> indices(ranges);
+    std::iota(indices.begin(), indices.end(), 0);
+
+    // count, to know where every range goes, and check that the inputs are
+    // sorted without duplicates. The splitters only partition sorted inputs
+    // correctly, so every input is checked in even parts of its own instead.
+    std::vector<size_t> offsets(ranges + 1, 0);
+    // unordered[r][i]: the first out of order shape in part r of input i
+    std::vector<std::vector<size_t>> unordered(ranges, std::vector<size_t>(inputs.size()));
+    std::for_each(std::execution::par, indices.begin(), indices.end(), [&](size_t r) {
+        for (size_t i{}; i < inputs.size(); ++i) {
+            auto const size = inputs[i]->size();
+            unordered[r][i] = first_unordered(*inputs[i], r * size / ranges, (r + 1) * size / ranges);
+        }
+        size_t n{};
+        merge_sets(inputs, bounds[r], bounds[r + 1], op, [&](DynPolyCube const&) { ++n; });
+        offsets[r + 1] = n;
+    });
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    for (size_t r{}; r < ranges; ++r) {
+        for (size_t i{}; i < inputs.size(); ++i) {
+            auto const& in = *inputs[i];
+            auto const j = unordered[r][i];
+            if (j == (r + 1) * in.size() / ranges) continue;
+            throw std::runtime_error(std::format("{} is not sorted: shape {} is {} the shape before it",
+                infiles[i].string(), j, in[j] == in[j - 1] ? "a duplicate of" : "smaller than"));
+        }
+    }
+
+    try {
+        write_ranges(inputs, bounds, offsets, outfile, op);
+    } catch (std::runtime_error const&) {
+        // don't leave a file behind that may have the right size, but holes
+        std::error_code ec;
+        if (std::filesystem::is_regular_file(outfile, ec)) std::filesystem::remove(outfile, ec);
+        throw;
+    }
+    return offsets.back();
+}
+
+int main(int argc, char const* const* argv)
+{
+    using namespace std::string_view_literals;
+
+    std::vector<std::filesystem::path> infiles;
+    std::filesystem::path outfile;
+    MergeOp op = MergeOp::union_;
+
+    for (int i{1}; i < argc; ++i) {
+        std::string_view arg{argv[i]};
+
+        if (arg == "-h"sv || arg == "--help"sv) {
+            std::cout << std::format("Usage: {} [--difference | --intersection] -o OUTFILE INFILE...\n", argv[0]);
+            return 0;
+        } else if ((arg == "-o"sv || arg == "--output"sv) && i + 1 < argc) {
+            outfile = argv[++i];
+        } else if (arg == "--difference"sv) {
+            op = MergeOp::difference;
+        } else if (arg == "--intersection"sv) {
+            op = MergeOp::intersection;
+        } else {
+            infiles.emplace_back(arg);
+        }
+    }
+
+    if (infiles.empty() || outfile.empty()) {
+        std::cerr << "Invalid argument count\n";
+        return 2;
+    }
+    for (auto const& f : infiles) {
+        if (std::filesystem::exists(outfile) && std::filesystem::equivalent(f, outfile)) {
+            std::cerr << std::format("The output file {} is also an input\n", outfile.string());
+            return 2;
+        }
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    size_t count{};
+    try {
+        count = merge_files(infiles, outfile, op);
+    } catch (std::invalid_argument const& e) {
+        std::cerr << e.what() << '\n';
+        return 2;
+    } catch (std::runtime_error const& e) {
+        // also I/O errors (std::filesystem::filesystem_error)
+        std::cerr << "ERROR: " << e.what() << '\n';
+        return 1;
+    }
+    auto dt = seconds_between(t0, std::chrono::steady_clock::now());
+
+    std::cout << std::format("{} shapes written to {} in {:.2f} s\n", count, outfile.string(), dt);
+    return 0;
+}
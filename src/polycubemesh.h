@@ -0,0 +1,145 @@
+#ifndef POLYCUBES_POLYCUBEMESH_H_
+#define POLYCUBES_POLYCUBEMESH_H_
+
+#include "coord.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Surface meshes of polycubes: one quad per cube face that isn't shared with
+// a neighbouring cube. Faces between two cubes of the same shape can never be
+// seen, so they are left out.
+
+using vec3 = std::array<float, 3>;
+
+struct CubeFace
+{
+    // towards the neighbour that would hide this face
+    Coord direction;
+    vec3 normal;
+    // corners relative to the cube centre, counter-clockwise seen from outside
+    std::array<vec3, 4> corners;
+};
+
+inline std::array<CubeFace, 6> const CUBE_FACES{{
+    {Coord{0, 0, -1}, {0.f, 0.f, -1.f},
+        {{{-.5f, .5f, -.5f}, {.5f, .5f, -.5f}, {.5f, -.5f, -.5f}, {-.5f, -.5f, -.5f}}}},
+    {Coord{0, 0, 1}, {0.f, 0.f, 1.f},
+        {{{-.5f, -.5f, .5f}, {.5f, -.5f, .5f}, {.5f, .5f, .5f}, {-.5f, .5f, .5f}}}},
+    {Coord{0, -1, 0}, {0.f, -1.f, 0.f},
+        {{{-.5f, -.5f, -.5f}, {.5f, -.5f, -.5f}, {.5f, -.5f, .5f}, {-.5f, -.5f, .5f}}}},
+    {Coord{0, 1, 0}, {0.f, 1.f, 0.f},
+        {{{-.5f, .5f, .5f}, {.5f, .5f, .5f}, {.5f, .5f, -.5f}, {-.5f, .5f, -.5f}}}},
+    {Coord{-1, 0, 0}, {-1.f, 0.f, 0.f},
+        {{{-.5f, -.5f, .5f}, {-.5f, .5f, .5f}, {-.5f, .5f, -.5f}, {-.5f, -.5f, -.5f}}}},
+    {Coord{1, 0, 0}, {1.f, 0.f, 0.f},
+        {{{.5f, -.5f, -.5f}, {.5f, .5f, -.5f}, {.5f, .5f, .5f}, {.5f, -.5f, .5f}}}},
+}};
+
+struct Quad
+{
+    std::array<vec3, 4> vertices;
+    // index into CUBE_FACES
+    int face;
+};
+
+// Call f(Quad const&) for every exposed face of the shape, moved by offset.
+// The cubes of a normalized shape are sorted, so neighbours are found by
+// binary search.
+template <typename F>
+void for_each_visible_face(std::span<const Coord> shape, vec3 const& offset, F&& f)
+{
+    for (auto const& cube : shape) {
+        for (int i = 0; i < (int)CUBE_FACES.size(); ++i) {
+            auto const& face = CUBE_FACES[i];
+            if (std::binary_search(shape.begin(), shape.end(), cube + face.direction)) continue;
+
+            Quad q;
+            q.face = i;
+            for (size_t k{}; k < 4; ++k) {
+                q.vertices[k] = vec3{
+                    offset[0] + cube.x() + face.corners[k][0],
+                    offset[1] + cube.y() + face.corners[k][1],
+                    offset[2] + cube.z() + face.corners[k][2]};
+            }
+            f(q);
+        }
+    }
+}
+
+// Indexed mesh of one shape: its exposed faces, with the corners they share
+// merged into one vertex. The buffers are reused from shape to shape.
+struct ShapeMesh
+{
+    std::vector<vec3> vertices;
+    std::vector<std::array<uint32_t, 4>> quads;
+    // index into CUBE_FACES, per quad
+    std::vector<int> faces;
+
+    void build(std::span<const Coord> shape, vec3 const& offset)
+    {
+        vertices.clear();
+        quads.clear();
+        faces.clear();
+        m_corners.clear();
+
+        // corners in doubled coordinates, so they are integers
+        for_each_visible_face(shape, vec3{}, [&](Quad const& q) {
+            for (auto const& v : q.vertices) m_corners.push_back(corner_key(v));
+            faces.push_back(q.face);
+        });
+        m_unique.assign(m_corners.begin(), m_corners.end());
+        std::sort(m_unique.begin(), m_unique.end());
+        m_unique.erase(std::unique(m_unique.begin(), m_unique.end()), m_unique.end());
+
+        for (auto const& key : m_unique) {
+            vertices.push_back(vec3{offset[0] + 0.5f * float(key[0]),
+                                    offset[1] + 0.5f * float(key[1]),
+                                    offset[2] + 0.5f * float(key[2])});
+        }
+        for (size_t i{}; i < faces.size(); ++i) {
+            std::array<uint32_t, 4> quad;
+            for (size_t k{}; k < 4; ++k) {
+                auto key = m_corners[4 * i + k];
+                quad[k] = (uint32_t)(std::lower_bound(m_unique.begin(), m_unique.end(), key) - m_unique.begin());
+            }
+            quads.push_back(quad);
+        }
+    }
+
+private:
+    using CornerKey = std::array<int, 3>;
+
+    static CornerKey corner_key(vec3 const& v)
+    {
+        return CornerKey{(int)std::lround(2 * v[0]), (int)std::lround(2 * v[1]), (int)std::lround(2 * v[2])};
+    }
+
+    std::vector<CornerKey> m_corners;
+    std::vector<CornerKey> m_unique;
+};
+
+// Lays the shapes out side by side on a square grid in the xy plane
+struct GridLayout
+{
+    size_t width;
+    float spacing;
+
+    GridLayout(size_t shape_count, size_t cube_count)
+        : width{std::max<size_t>(1, static_cast<size_t>(std::sqrt(double(shape_count))))},
+          spacing{2.f * float(cube_count)}
+    {
+    }
+
+    vec3 offset(size_t index) const
+    {
+        return vec3{spacing * float(index % width), spacing * float(index / width), 0.f};
+    }
+};
+
+#endif // POLYCUBES_POLYCUBEMESH_H_
@@ -0,0 +1,161 @@
+#include "dynpolycube.h"
+#include "polycubeindex.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Looks up shapes in a polycube list: for every query, prints "found INDEX"
+// or "missing RANK" (the number of smaller shapes in the list), or "error ..."
+// if the query can't be parsed. A query is a shape as a list of cube
+// coordinates, "x,y,z x,y,z ...", in any orientation and position. Queries
+// are taken from the command line, or else one per line from stdin.
+
+// number of queries from stdin that are looked up together (in sorted order,
+// so that queries in the same block share the disk read)
+size_t constexpr QUERY_BATCH_SIZE = 65536;
+
+struct Query
+{
+    std::string error;
+    // normalized
+    std::vector<Coord> shape;
+    PolyCubeLookup result{};
+};
+
+Query parse_query(std::string_view line, size_t cube_count)
+{
+    Query q;
+
+    // all integers on the line, in groups of three
+    std::vector<long> values;
+    auto const* p = line.data();
+    auto const* end = line.data() + line.size();
+    while (p != end) {
+        if (*p == '-' || (*p >= '0' && *p <= '9')) {
+            long v{};
+            auto [next, ec] = std::from_chars(p, end, v);
+            if (ec != std::errc{}) {
+                q.error = "invalid number";
+                return q;
+            }
+            values.push_back(v);
+            p = next;
+        } else {
+            ++p;
+        }
+    }
+    if (values.size() % 3 != 0) {
+        q.error = "coordinates must come in groups of three";
+        return q;
+    }
+    if (values.size() / 3 != cube_count) {
+        q.error = std::format("expected {} cubes, got {}", cube_count, values.size() / 3);
+        return q;
+    }
+
+    // move it next to the origin, so that it fits into Coord
+    std::array<long, 3> lo{values[0], values[1], values[2]};
+    for (size_t i{}; i < values.size(); ++i) lo[i % 3] = std::min(lo[i % 3], values[i]);
+
+    std::vector<Coord> cubes;
+    for (size_t i{}; i < values.size(); i += 3) {
+        std::array<long, 3> c{values[i] - lo[0], values[i + 1] - lo[1], values[i + 2] - lo[2]};
+        if (std::max({c[0], c[1], c[2]}) >= (long)MAX_CUBE_COUNT) {
+            q.error = "shape is too large";
+            return q;
+        }
+        cubes.push_back(Coord{Coord::Scalar(c[0]), Coord::Scalar(c[1]), Coord::Scalar(c[2])});
+    }
+
+    q.shape.resize(cubes.size());
+    normalize(cubes, q.shape);
+    return q;
+}
+
+void answer(PolyCubeIndex& index, std::vector<Query>& queries)
+{
+    // look them up in sorted order
+    std::vector<size_t> order(queries.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return DynPolyCube{queries[a].shape} < DynPolyCube{queries[b].shape};
+    });
+    for (auto i : order) {
+        if (queries[i].error.empty()) queries[i].result = index.find_normal(DynPolyCube{queries[i].shape});
+    }
+
+    for (auto const& q : queries) {
+        if (!q.error.empty()) {
+            std::cout << "error " << q.error << '\n';
+        } else {
+            std::cout << (q.result.found ? "found " : "missing ") << q.result.index << '\n';
+        }
+    }
+}
+
+int main(int argc, char const* const* argv)
+{
+    using namespace std::string_view_literals;
+
+    std::filesystem::path list_file;
+    std::vector<std::string> args;
+    bool verbose = false;
+
+    for (int i{1}; i < argc; ++i) {
+        std::string_view arg{argv[i]};
+
+        if (arg == "-h"sv || arg == "--help"sv) {
+            std::cout << std::format("Usage: {} [-v] LIST_FILE [\"x,y,z x,y,z ...\" ...]\n", argv[0]);
+            return 0;
+        } else if (arg == "-v"sv || arg == "--verbose"sv) {
+            verbose = true;
+        } else if (list_file.empty()) {
+            list_file = arg;
+        } else {
+            args.emplace_back(arg);
+        }
+    }
+
+    if (list_file.empty()) {
+        std::cerr << "Invalid argument count\n";
+        return 2;
+    }
+
+    PolyCubeIndex index{list_file};
+    auto const cube_count = index.cube_count();
+    size_t query_count{};
+
+    std::vector<Query> batch;
+    auto flush = [&] {
+        answer(index, batch);
+        query_count += batch.size();
+        batch.clear();
+    };
+
+    if (!args.empty()) {
+        for (auto const& a : args) batch.push_back(parse_query(a, cube_count));
+        flush();
+    } else {
+        std::string line;
+        while (std::getline(std::cin, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            batch.push_back(parse_query(line, cube_count));
+            if (batch.size() >= QUERY_BATCH_SIZE) flush();
+        }
+        flush();
+    }
+
+    if (verbose) {
+        std::cerr << std::format("{} queries on {} ({})-cubes, {} blocks read\n",
+            query_count, index.size(), cube_count, index.block_reads());
+    }
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include "polycubes.h"
+
+#include "polycubeio.h"
+#include "polycubesearch.h"
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+
+static void check_options(EnumerationOptions const& options)
+{
+    if (options.batch_seeds == 0) throw std::invalid_argument("batch_seeds must be positive");
+}
+
+static long expand_batch(PolyCubeArena const& batch, ShapeBatchCallback const& on_batch,
+                         EnumerationOptions const& options)
+{
+    auto result = find_all_one_larger(batch, options.box, options.unique);
+    if (!result.empty()) on_batch(result);
+    return (long)result.size();
+}
+
+long enumerate_one_larger(PolyCubeArena const& seeds, ShapeBatchCallback const& on_batch,
+                          EnumerationOptions const& options)
+{
+    return enumerate_one_larger(std::span{seeds.data(), seeds.size() * seeds.cube_count()}, seeds.cube_count(),
+        on_batch, options);
+}
+
+long enumerate_one_larger(std::span<const Coord> seeds, size_t cube_count, ShapeBatchCallback const& on_batch,
+                          EnumerationOptions const& options)
+{
+    check_options(options);
+    if (cube_count == 0 || cube_count >= MAX_CUBE_COUNT) {
+        throw std::invalid_argument(std::format("invalid cube count: {}", cube_count));
+    }
+    if (seeds.size() % cube_count != 0) {
+        throw std::invalid_argument(std::format("{} coordinates are not a whole number of {}-cubes",
+            seeds.size(), cube_count));
+    }
+
+    auto const seed_count = seeds.size() / cube_count;
+    long count{};
+    PolyCubeArena batch{cube_count};
+    for (size_t first{}; first < seed_count; first += options.batch_seeds) {
+        auto const n = std::min(options.batch_seeds, seed_count - first);
+        batch.clear();
+        batch.push_back(seeds.subspan(first * cube_count, n * cube_count));
+        count += expand_batch(batch, on_batch, options);
+    }
+    return count;
+}
+
+long enumerate_one_larger(std::filesystem::path const& seed_file, size_t first, size_t count,
+                          ShapeBatchCallback const& on_batch, EnumerationOptions const& options)
+{
+    check_options(options);
+    PolyCubeListFileReader reader{seed_file};
+    if (first > reader.size() || count > reader.size() - first) {
+        throw std::invalid_argument(std::format("seeds {}..{} out of range, {} has {}",
+            first, first + count, seed_file.string(), reader.size()));
+    }
+
+    auto const cube_count = (size_t)reader.cube_count();
+    if (cube_count >= MAX_CUBE_COUNT) throw std::invalid_argument("too many cubes");
+
+    long result{};
+    PolyCubeArena batch{cube_count};
+    for (size_t i{}; i < count; i += options.batch_seeds) {
+        reader.read(first + i, std::min(options.batch_seeds, count - i), batch);
+        result += expand_batch(batch, on_batch, options);
+    }
+    return result;
+}
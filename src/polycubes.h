@@ -0,0 +1,75 @@
+#ifndef POLYCUBES_POLYCUBES_H_
+#define POLYCUBES_POLYCUBES_H_
+
+#include "boxconstraint.h"
+#include "dynpolycube.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <iterator>
+#include <span>
+#include <vector>
+
+// Library interface (the polycubes target): generates the polycubes one
+// larger than a set of seeds and hands them to the caller in memory, without
+// going through list files. The engine behind it is the runtime-sized search
+// of polycubegen; it is parallel, and works for any cube count.
+
+#define POLYCUBES_API_VERSION 1
+
+struct EnumerationOptions
+{
+    // only generate polycubes that fit into this box
+    BoxConstraint box{};
+    // number of seeds that are expanded together; the shapes grown from them
+    // are delivered as one batch, sorted and without duplicates
+    size_t batch_seeds = 65536;
+    // Deliver every shape only from its canonical parent, so that no shape is
+    // delivered twice, also not across batches or across calls with disjoint
+    // seed ranges. This requires that the seeds, taken together, are all the
+    // polycubes of their size (that fit into the box). If false, the same
+    // shape can come up again in later batches, but the search is faster.
+    bool unique = true;
+};
+
+// Receives a batch of normalized polycubes, one cube larger than the seeds.
+// The batch is only valid during the call.
+using ShapeBatchCallback = std::function<void(PolyCubeArena const& batch)>;
+
+// Expands normalized seeds held in memory. Returns the number of shapes
+// delivered.
+long enumerate_one_larger(PolyCubeArena const& seeds, ShapeBatchCallback const& on_batch,
+                          EnumerationOptions const& options = {});
+
+// The same, for seeds as a flat array of coordinates, cube_count per shape
+// (the layout of PolyCubeArena and of list files)
+long enumerate_one_larger(std::span<const Coord> seeds, size_t cube_count, ShapeBatchCallback const& on_batch,
+                          EnumerationOptions const& options = {});
+
+// Expands the seeds [first, first + count) of a list file; the seeds are read
+// one batch at a time
+long enumerate_one_larger(std::filesystem::path const& seed_file, size_t first, size_t count,
+                          ShapeBatchCallback const& on_batch, EnumerationOptions const& options = {});
+
+// Output iterator variants: every shape is written as a std::vector<Coord>
+template <std::output_iterator<std::vector<Coord>> OutputIt>
+OutputIt enumerate_one_larger_to(PolyCubeArena const& seeds, OutputIt out, EnumerationOptions const& options = {})
+{
+    enumerate_one_larger(seeds, [&](PolyCubeArena const& batch) {
+        for (auto const& s : batch) *out++ = std::vector<Coord>(s.cubes.begin(), s.cubes.end());
+    }, options);
+    return out;
+}
+
+template <std::output_iterator<std::vector<Coord>> OutputIt>
+OutputIt enumerate_one_larger_to(std::filesystem::path const& seed_file, size_t first, size_t count,
+                                 OutputIt out, EnumerationOptions const& options = {})
+{
+    enumerate_one_larger(seed_file, first, count, [&](PolyCubeArena const& batch) {
+        for (auto const& s : batch) *out++ = std::vector<Coord>(s.cubes.begin(), s.cubes.end());
+    }, options);
+    return out;
+}
+
+#endif // POLYCUBES_POLYCUBES_H_
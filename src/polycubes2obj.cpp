@@ -1,175 +1,159 @@
+#include "dynpolycube.h"
+#include "meshwriters.h"
 #include "polycubeio.h"
-#include "util.h"
-
-#include <array>
-#include <cmath>
+#include "polycubemesh.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <execution>
+#include <filesystem>
 #include <iostream>
 #include <format>
-#include <fstream>
-
-template <size_t SIZE>
-struct convert_impl
+#include <limits>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// shapes per MeshBlock
+size_t constexpr MESH_BLOCK_SIZE = 4096;
+
+// The shapes to convert: a range of the list, or a sorted random sample.
+// Only those are read from the file, and they are laid out next to each other.
+class ShapeSelection
 {
-    using vec3 = std::array<float, 3>;
+public:
+    // everything
+    ShapeSelection() = default;
 
-    struct SquareFace {
-        std::array<vec3, 4> vertices;
-        vec3 normal;
-    };
+    // [begin, end)
+    ShapeSelection(size_t begin, size_t end) : m_begin{begin}, m_end{end} {}
 
-    static std::vector<SquareFace> make_faces(Coord cube)
+    // parse "START:END" (END exclusive; "START:" for the rest of the list)
+    static ShapeSelection parse_range(std::string_view spec)
     {
-        std::vector<SquareFace> result;
-        result.push_back(SquareFace{
-            .vertices={
-                vec3{cube.x() - 0.5f, cube.y() + 0.5f, cube.z() - 0.5f},
-                vec3{cube.x() + 0.5f, cube.y() + 0.5f, cube.z() - 0.5f},
-                vec3{cube.x() + 0.5f, cube.y() - 0.5f, cube.z() - 0.5f},
-                vec3{cube.x() - 0.5f, cube.y() - 0.5f, cube.z() - 0.5f},
-            },
-            .normal={0.f, 0.f, -1.f}
-        });
-        result.push_back(SquareFace{
-            .vertices={
-                vec3{cube.x() - 0.5f, cube.y() - 0.5f, cube.z() + 0.5f},
-                vec3{cube.x() + 0.5f, cube.y() - 0.5f, cube.z() + 0.5f},
-                vec3{cube.x() + 0.5f, cube.y() + 0.5f, cube.z() + 0.5f},
-                vec3{cube.x() - 0.5f, cube.y() + 0.5f, cube.z() + 0.5f},
-            },
-            .normal={0.f, 0.f, 1.f}
-        });
-        result.push_back(SquareFace{
-            .vertices={
-                vec3{cube.x() - 0.5f, cube.y() - 0.5f, cube.z() - 0.5f},
-                vec3{cube.x() + 0.5f, cube.y() - 0.5f, cube.z() - 0.5f},
-                vec3{cube.x() + 0.5f, cube.y() - 0.5f, cube.z() + 0.5f},
-                vec3{cube.x() - 0.5f, cube.y() - 0.5f, cube.z() + 0.5f},
-            },
-            .normal={0.f, -1.f, 0.f}
-        });
-        result.push_back(SquareFace{
-            .vertices={
-                vec3{cube.x() - 0.5f, cube.y() + 0.5f, cube.z() + 0.5f},
-                vec3{cube.x() + 0.5f, cube.y() + 0.5f, cube.z() + 0.5f},
-                vec3{cube.x() + 0.5f, cube.y() + 0.5f, cube.z() - 0.5f},
-                vec3{cube.x() - 0.5f, cube.y() + 0.5f, cube.z() - 0.5f},
-            },
-            .normal={0.f, 1.f, 0.f}
-        });
-        result.push_back(SquareFace{
-            .vertices={
-                vec3{cube.x() - 0.5f, cube.y() - 0.5f, cube.z() + 0.5f},
-                vec3{cube.x() - 0.5f, cube.y() + 0.5f, cube.z() + 0.5f},
-                vec3{cube.x() - 0.5f, cube.y() + 0.5f, cube.z() - 0.5f},
-                vec3{cube.x() - 0.5f, cube.y() - 0.5f, cube.z() - 0.5f},
-            },
-            .normal={-1.f, 0.f, 0.f}
-        });
-        result.push_back(SquareFace{
-            .vertices={
-                vec3{cube.x() + 0.5f, cube.y() - 0.5f, cube.z() - 0.5f},
-                vec3{cube.x() + 0.5f, cube.y() + 0.5f, cube.z() - 0.5f},
-                vec3{cube.x() + 0.5f, cube.y() + 0.5f, cube.z() + 0.5f},
-                vec3{cube.x() + 0.5f, cube.y() - 0.5f, cube.z() + 0.5f},
-            },
-            .normal={1.f, 0.f, 0.f}
-        });
+        auto colon = spec.find(':');
+        if (colon == std::string_view::npos) throw std::invalid_argument("range must be START:END");
+        auto begin = parse_index(spec.substr(0, colon));
+        auto end = colon + 1 == spec.size() ? std::numeric_limits<size_t>::max() : parse_index(spec.substr(colon + 1));
+        if (end < begin) throw std::invalid_argument("range end before start");
+        return ShapeSelection{begin, end};
+    }
 
+    // k distinct shapes out of shape_count, chosen uniformly (Floyd's algorithm)
+    static ShapeSelection sample(size_t shape_count, size_t k, uint64_t seed)
+    {
+        k = std::min(k, shape_count);
+        std::mt19937_64 rng{seed};
+        std::unordered_set<size_t> chosen;
+        chosen.reserve(k);
+        for (size_t j = shape_count - k; j < shape_count; ++j) {
+            auto t = std::uniform_int_distribution<size_t>{0, j}(rng);
+            if (!chosen.insert(t).second) chosen.insert(j);
+        }
+        ShapeSelection result;
+        result.m_indices.assign(chosen.begin(), chosen.end());
+        std::sort(result.m_indices.begin(), result.m_indices.end());
+        result.m_sampled = true;
         return result;
     }
 
-    static void translate_vertices(std::vector<SquareFace>& faces, vec3 d)
+    // clamp the range to the list
+    void fit(size_t shape_count)
     {
-        for (auto& f : faces) {
-            for (auto& v : f.vertices) {
-                v[0] += d[0];
-                v[1] += d[1];
-                v[2] += d[2];
-            }
-        }
+        m_end = std::min(m_end, shape_count);
+        m_begin = std::min(m_begin, m_end);
     }
 
-    static std::vector<SquareFace> make_faces(PolyCube<SIZE> const& pc)
+    size_t size() const { return m_sampled ? m_indices.size() : m_end - m_begin; }
+
+    // read the selected shapes [first, first + count) into out
+    void read(PolyCubeListFileReader& reader, size_t first, size_t count, PolyCubeArena& out) const
     {
-        std::vector<SquareFace> result;
+        if (!m_sampled) return reader.read(m_begin + first, count, out);
 
-        for (const auto& cube : pc.cubes) {
-            auto cube_faces = make_faces(cube);
-            std::copy(cube_faces.begin(), cube_faces.end(), std::back_inserter(result));
+        out.clear();
+        PolyCubeArena one{out.cube_count()};
+        for (size_t i = first; i < first + count; ++i) {
+            reader.read(m_indices[i], 1, one);
+            out.push_back(one[0].cubes);
         }
-
-        return result;
     }
 
-    static std::vector<SquareFace> make_faces(std::vector<PolyCube<SIZE>> const& pcs, size_t grid_width, float spacing)
+private:
+    static size_t parse_index(std::string_view s)
     {
-        std::vector<SquareFace> result;
-
-        size_t x{}, y{};
-
-        for (const auto& pc : pcs)
-        {
-            auto pc_faces = make_faces(pc);
-
-            vec3 offset{0.f, 0.f, 0.f};
-            offset[0] = spacing * x;
-            offset[1] = spacing * y;
-
-            translate_vertices(pc_faces, offset);
-
-            std::copy(pc_faces.begin(), pc_faces.end(), std::back_inserter(result));
-
-            if (++x >= grid_width) {
-                x = 0;
-                ++y;
-            }
+        size_t value{};
+        auto [p, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+        if (ec != std::errc{} || p != s.data() + s.size()) {
+            throw std::invalid_argument(std::format("invalid index: {}", s));
         }
-        
-        return result;
+        return value;
     }
 
+    size_t m_begin{};
+    size_t m_end{std::numeric_limits<size_t>::max()};
+    bool m_sampled{};
+    std::vector<size_t> m_indices;
+};
 
-    void operator()(PolyCubeListFileReader& reader, std::filesystem::path& outfile) const
-    {
-        auto polycubes = reader.slurp<SIZE>();
-        auto count = polycubes.size();
+template <typename Writer>
+void convert_with(PolyCubeListFileReader& reader, std::filesystem::path const& outfile, ShapeSelection const& selection)
+{
+    auto const shape_count = selection.size();
+    auto const cube_count = (size_t)reader.cube_count();
+
+    // Spread them out on a grid
+    GridLayout const layout{shape_count, cube_count};
+    Writer writer{outfile, shape_count, cube_count};
+
+    // one block per thread at a time, so the memory use stays bounded
+    std::vector<MeshBlock> blocks(std::max(1u, std::thread::hardware_concurrency()));
+    for (auto& b : blocks) b.shapes = PolyCubeArena{cube_count};
+
+    for (size_t first{}; first < shape_count; first += blocks.size() * MESH_BLOCK_SIZE) {
+        size_t used{};
+        for (auto& b : blocks) {
+            b.clear();
+            b.first_position = first + used * MESH_BLOCK_SIZE;
+            if (b.first_position >= shape_count) break;
+            selection.read(reader, b.first_position, std::min(MESH_BLOCK_SIZE, shape_count - b.first_position), b.shapes);
+            ++used;
+        }
+        auto active = std::span{blocks}.first(used);
 
-        // Spread them out on a grid
-        auto grid_width = static_cast<size_t>(std::sqrt(count));
-        auto spacing = 2 * SIZE;
+        std::for_each(std::execution::par, active.begin(), active.end(),
+            [&](MeshBlock& b) { Writer::build(b, layout); });
 
-        auto faces = make_faces(polycubes, grid_width, (float)spacing);
+        auto vertex_base = writer.vertex_count();
+        for (auto& b : active) {
+            b.vertex_base = vertex_base;
+            vertex_base += b.vertices.size();
+        }
 
-        std::ofstream ofs{outfile, std::ios::out | std::ios::trunc};
+        std::for_each(std::execution::par, active.begin(), active.end(),
+            [&](MeshBlock& b) { Writer::encode(b); });
 
-        // write vertices
-        ofs << "# List of vertices\n";
-        for (auto const& f : faces) {
-            for (auto const& v : f.vertices) {
-                ofs << std::format("v {} {} {}\n", v[0], v[1], v[2]);
-            }
-        }
-        // write vertex normals
-        ofs << "# List of vertex normals\n";
-        for (auto const& f : faces) {
-            ofs << std::format("vn {} {} {}\n", f.normal[0], f.normal[1], f.normal[2]);
-        }
-        // write faces
-        ofs << "# List of faces\n";
-        for (size_t i{}; i < faces.size(); ++i) {
-            size_t v0 = 4 * i + 1;
-            size_t vn = i + 1;
-            ofs << std::format("f {}//{} {}//{} {}//{} {}//{}\n",
-                v0, vn, v0+1, vn, v0+2, vn, v0+3, vn);
-        }
+        for (auto const& b : active) writer.append(b);
     }
-};
+    writer.finish();
+}
 
-void convert(std::filesystem::path const& infile, std::filesystem::path& outfile)
+void convert(PolyCubeListFileReader& reader, std::filesystem::path const& outfile, MeshFormat format,
+             ShapeSelection const& selection)
 {
-    PolyCubeListFileReader reader{infile};
-
-    metaswitch<size_t, 12, convert_impl>{}(reader.cube_count(), reader, outfile);
+    switch (format) {
+    case MeshFormat::obj: return convert_with<ObjWriter>(reader, outfile, selection);
+    case MeshFormat::ply: return convert_with<PlyWriter>(reader, outfile, selection);
+    case MeshFormat::stl: return convert_with<StlWriter>(reader, outfile, selection);
+    case MeshFormat::glb: return convert_with<GlbWriter>(reader, outfile, selection);
+    }
 }
 
 int main(int argc, char const* const* argv)
@@ -179,25 +163,82 @@ int main(int argc, char const* const* argv)
 
     std::filesystem::path infile;
     std::filesystem::path outfile;
+    std::optional<MeshFormat> format;
+    std::optional<ShapeSelection> range;
+    std::optional<size_t> sample_size;
+    uint64_t sample_seed{1};
+    // appended to the default output file name
+    std::string suffix;
+
+    try {
+        for (int i{1}; i < argc; ++i) {
+            std::string_view arg{argv[i]};
+
+            if (arg == "-h"sv || arg == "--help"sv) {
+                std::cout << std::format("Usage: {} [--format obj|ply|stl|glb] [--range START:END] "
+                                         "[--sample K [--seed S]] INFILE [OUTFILE]\n", argv[0]);
+                return 0;
+            } else if (arg == "--format"sv && i + 1 < argc) {
+                format = parse_mesh_format(argv[++i]);
+            } else if (arg == "--range"sv && i + 1 < argc) {
+                range = ShapeSelection::parse_range(argv[++i]);
+                suffix = std::format("_{}", argv[i]);
+                std::replace(suffix.begin(), suffix.end(), ':', '-');
+            } else if (arg == "--sample"sv && i + 1 < argc) {
+                sample_size = std::strtoull(argv[++i], nullptr, 10);
+            } else if (arg == "--seed"sv && i + 1 < argc) {
+                sample_seed = std::strtoull(argv[++i], nullptr, 10);
+            } else if (infile.empty()) {
+                infile = arg;
+            } else if (outfile.empty()) {
+                outfile = arg;
+            } else {
+                std::cerr << "Invalid argument count\n";
+                return 2;
+            }
+        }
+
+        if (infile.empty()) {
+            std::cerr << "Invalid argument count\n";
+            return 2;
+        }
+        if (range && sample_size) {
+            std::cerr << "ERROR: --range and --sample can't be combined\n";
+            return 2;
+        }
+        if (sample_size) suffix = std::format("_sample{}_seed{}", *sample_size, sample_seed);
 
-    if (argc >= 2 && (argv[1] == "-h"sv || argv[1] == "--help"sv)) {
-        std::cout << std::format("Usage: {} INFILE [OUTFILE]\n", argv[0]);
-        return 0;
-    } else if (argc == 3) {
-        infile = argv[1];
-        outfile = argv[2];
-    } else if (argc == 2) {
-        infile = argv[1];
-        if (infile.extension() == ".bin"sv) {
-            outfile = infile.parent_path() / (infile.stem().string() + ".obj"s);
-        } else {
-            outfile = infile.parent_path() / (infile.filename().string() + ".obj"s);
+        // the format comes from --format, or else from the output file name
+        if (!format) format = mesh_format_of_file(outfile);
+
+        if (outfile.empty()) {
+            auto ext = mesh_format_extension(*format);
+            if (infile.extension() == ".bin"sv) {
+                outfile = infile.parent_path() / (infile.stem().string() + suffix + ext);
+            } else {
+                outfile = infile.parent_path() / (infile.filename().string() + suffix + ext);
+            }
         }
-    } else {
-        std::cerr << "Invalid argument count\n";
+    } catch (std::invalid_argument const& e) {
+        std::cerr << "ERROR: " << e.what() << '\n';
         return 2;
     }
 
-    convert(infile, outfile);
+    PolyCubeListFileReader reader{infile};
+
+    ShapeSelection selection;
+    if (range) selection = *range;
+    if (sample_size) selection = ShapeSelection::sample(reader.size(), *sample_size, sample_seed);
+    selection.fit(reader.size());
+
+    try {
+        convert(reader, outfile, *format, selection);
+    } catch (std::runtime_error const& e) {
+        // don't leave a truncated mesh behind
+        std::cerr << "ERROR: " << e.what() << '\n';
+        std::error_code ec;
+        if (std::filesystem::is_regular_file(outfile, ec)) std::filesystem::remove(outfile, ec);
+        return 1;
+    }
     return 0;
 }
@@ -0,0 +1,342 @@
+#include "cpudispatch.h"
+#include "polycube.h"
+#include "polycubeio.h"
+#include "polycubesearch.h"
+#include "util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Microbenchmarks for the core kernels. Every benchmark works on the same
+// fixed input (all polycubes up to SEED_SIZE, generated at startup), so the
+// numbers are comparable between commits.
+
+size_t constexpr SEED_SIZE = 8;
+
+template <typename T>
+inline void keep(T const& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r"(&value) : "memory");
+#else
+    static volatile char const* sink;
+    sink = reinterpret_cast<char const*>(&value);
+#endif
+}
+
+struct BenchResult
+{
+    std::string name;
+    long iterations{};
+    long items{};
+    double ns_per_item{};
+    double items_per_second{};
+};
+
+class BenchRunner
+{
+public:
+    BenchRunner(std::string filter, double min_time, int repetitions)
+        : m_filter{std::move(filter)}, m_min_time{min_time}, m_repetitions{repetitions}
+    {
+    }
+
+    using Clock = std::chrono::steady_clock;
+
+    // Stopwatch for run_timed(): only the time between start() and stop()
+    // counts
+    class Timer
+    {
+    public:
+        void start() { m_start = Clock::now(); }
+        void stop() { m_elapsed += Clock::now() - m_start; }
+        double seconds() const { return m_elapsed.count(); }
+
+    private:
+        Clock::time_point m_start{};
+        std::chrono::duration<double> m_elapsed{};
+    };
+
+    // f() runs one iteration and returns the number of items it processed.
+    // The reported time is the best of several repetitions.
+    void run(std::string const& name, std::function<long()> const& f)
+    {
+        run_timed(name, [&](Timer& timer) {
+            timer.start();
+            auto items = f();
+            timer.stop();
+            return items;
+        });
+    }
+
+    // The same, but f(timer) times only the part of an iteration that is
+    // measured, so that it can prepare its input first
+    void run_timed(std::string const& name, std::function<long(Timer&)> const& f)
+    {
+        if (!m_filter.empty() && name.find(m_filter) == std::string::npos) return;
+
+        BenchResult best{.name = name};
+
+        for (int rep = 0; rep < m_repetitions; ++rep) {
+            long iterations{}, items{};
+            Timer timer;
+            // also stop when the untimed preparation takes most of the time
+            auto const deadline = Clock::now() + 10 * std::chrono::duration<double>{m_min_time};
+            do {
+                items += f(timer);
+                ++iterations;
+            } while (timer.seconds() < m_min_time && Clock::now() < deadline);
+
+            double ns_per_item = timer.seconds() * 1e9 / double(items);
+            if (rep == 0 || ns_per_item < best.ns_per_item) {
+                best.iterations = iterations;
+                best.items = items;
+                best.ns_per_item = ns_per_item;
+                best.items_per_second = 1e9 / ns_per_item;
+            }
+        }
+
+        std::cout << std::format("{:<40} {:>12.2f} ns/op {:>14.0f} items/s {:>10} iterations\n",
+            best.name, best.ns_per_item, best.items_per_second, best.iterations);
+        m_results.push_back(std::move(best));
+    }
+
+    void write_json(std::filesystem::path const& path) const
+    {
+        std::ofstream ofs{path, std::ios::out | std::ios::trunc};
+        ofs << "{\n";
+        ofs << std::format("  \"isa\": \"{}\",\n", isa_name(cpu_isa()));
+        ofs << std::format("  \"seed_size\": {},\n", SEED_SIZE);
+        ofs << "  \"benchmarks\": [\n";
+        for (size_t i{}; i < m_results.size(); ++i) {
+            auto const& r = m_results[i];
+            ofs << std::format("    {{\"name\": \"{}\", \"iterations\": {}, \"items\": {}, "
+                               "\"ns_per_op\": {:.4f}, \"items_per_second\": {:.1f}}}{}\n",
+                r.name, r.iterations, r.items, r.ns_per_item, r.items_per_second,
+                i + 1 < m_results.size() ? "," : "");
+        }
+        ofs << "  ]\n}\n";
+    }
+
+private:
+    std::string m_filter;
+    double m_min_time;
+    int m_repetitions;
+    std::vector<BenchResult> m_results;
+};
+
+// all polycubes of size SIZE, generated from scratch (in memory)
+template <size_t SIZE>
+std::vector<PolyCube<SIZE>> all_polycubes()
+{
+    if constexpr (SIZE == 1) {
+        return {PolyCube<1>{Coord{0, 0, 0}}};
+    } else {
+        auto smaller = all_polycubes<SIZE - 1>();
+        auto result = find_all_one_larger(smaller.begin(), smaller.end());
+        return {result.begin(), result.end()};
+    }
+}
+
+int main(int argc, char const* const* argv)
+{
+    using namespace std::string_view_literals;
+
+    std::filesystem::path json_file;
+    std::string filter;
+    double min_time = 0.5;
+    int repetitions = 3;
+
+    for (int i{1}; i < argc; ++i) {
+        std::string_view arg{argv[i]};
+
+        if (arg == "--json"sv && i + 1 < argc) {
+            json_file = argv[++i];
+        } else if (arg == "--filter"sv && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (arg == "--min-time"sv && i + 1 < argc) {
+            min_time = std::strtod(argv[++i], nullptr);
+        } else if (arg == "--repetitions"sv && i + 1 < argc) {
+            repetitions = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "-h"sv || arg == "--help"sv) {
+            std::cout << std::format("Usage: {} [--json FILE] [--filter NAME] [--min-time SECONDS] "
+                                     "[--repetitions N]\n", argv[0]);
+            return 0;
+        } else {
+            std::cerr << "Invalid argument: " << arg << '\n';
+            return 2;
+        }
+    }
+
+    std::cout << std::format("Using {} kernels\n", isa_name(cpu_isa()));
+
+    // Fixed input: the seed file for (SEED_SIZE+1)-cubes. The temporary
+    // files get a random tag so that concurrent runs don't clobber each other.
+    auto const tmp_dir = std::filesystem::temp_directory_path();
+    auto const tag = std::random_device{}();
+    auto const seed_file = tmp_dir / std::format("polycubes_bench_{:08x}_{}.bin", tag, SEED_SIZE);
+    auto const out_file = tmp_dir / std::format("polycubes_bench_{:08x}_{}.bin", tag, SEED_SIZE + 1);
+    {
+        PolyCubeListFileWriter<SEED_SIZE> writer{seed_file};
+        for (auto const& s : all_polycubes<SEED_SIZE>()) writer.write(s);
+    }
+    PolyCubeListFileReader seed_reader{seed_file};
+    auto const seeds = seed_reader.slurp<SEED_SIZE>();
+    auto const children = find_all_one_larger(seeds.begin(), seeds.end());
+    std::vector<PolyCube<SEED_SIZE + 1>> const sorted_children(children.begin(), children.end());
+
+    // unnormalized shapes: seeds with one block added, as find_larger produces them
+    std::vector<PolyCube<SEED_SIZE + 1>> candidates;
+    for (auto const& seed : seeds) {
+        for (auto const& block : seed.cubes) {
+            PolyCube<SEED_SIZE + 1> c;
+            if (try_adding_block(seed, block + Coord{1, 0, 0}, c)) candidates.push_back(c);
+        }
+    }
+
+    // the candidates in normal form (with duplicates), as they are inserted
+    std::vector<PolyCube<SEED_SIZE + 1>> normalized_candidates(candidates.size());
+    normalize_batch<SEED_SIZE + 1>(candidates, normalized_candidates);
+
+    std::cout << std::format("{} seeds, {} candidates, {} children\n",
+        seeds.size(), candidates.size(), sorted_children.size());
+
+    BenchRunner bench{filter, min_time, repetitions};
+
+    bench.run("Coord::rot", [&] {
+        long n{};
+        for (auto const& s : candidates) {
+            for (auto const& p : s.cubes) {
+                for (int r = 0; r < N_ROTATIONS; ++r) keep(p.rot(r));
+                n += N_ROTATIONS;
+            }
+        }
+        return n;
+    });
+
+    bench.run("PolyCube::rot", [&] {
+        long n{};
+        for (auto const& s : candidates) {
+            for (int r = 0; r < N_ROTATIONS; ++r) keep(s.rot(r));
+            n += N_ROTATIONS;
+        }
+        return n;
+    });
+
+    bench.run("PolyCube::normal", [&] {
+        for (auto const& s : candidates) keep(s.normal());
+        return (long)candidates.size();
+    });
+
+    std::vector<PolyCube<SEED_SIZE + 1>> batch_out(candidates.size());
+    bench.run("normalize_batch", [&] {
+        normalize_batch<SEED_SIZE + 1>(candidates, batch_out);
+        keep(batch_out);
+        return (long)candidates.size();
+    });
+
+    bench.run("find_larger (per seed)", [&] {
+        std::set<PolyCube<SEED_SIZE + 1>> out;
+        for (auto const& s : seeds) find_larger(s, out);
+        keep(out);
+        return (long)seeds.size();
+    });
+
+    bench.run("find_larger/trie (per seed)", [&] {
+        PolyCubeTrie<SEED_SIZE + 1> out;
+        for (auto const& s : seeds) find_larger(s, out);
+        keep(out);
+        return (long)seeds.size();
+    });
+
+    // how evenly the shapes (and so the inserting threads) are spread over
+    // the trie shards and their locks
+    PolyCubeTrie<SEED_SIZE + 1> trie;
+    for (auto const& s : sorted_children) trie.insert(s);
+    auto const shard_sizes = trie.shard_sizes();
+    auto const [smallest_shard, largest_shard] = std::ranges::minmax(shard_sizes);
+    std::cout << std::format("trie shards: {} shapes in {} shards, smallest {}, largest {} ({:.1f}%)\n",
+        trie.size(), shard_sizes.size(), smallest_shard, largest_shard,
+        100.0 * (double)largest_shard / (double)trie.size());
+
+    bench.run("PolyCubeTrie iterate", [&] {
+        long n{};
+        for (auto const& s : trie) {
+            keep(s);
+            ++n;
+        }
+        return n;
+    });
+
+    bench.run("std::set insert", [&] {
+        std::set<PolyCube<SEED_SIZE + 1>> out;
+        for (auto const& s : normalized_candidates) out.insert(s);
+        keep(out);
+        return (long)normalized_candidates.size();
+    });
+
+    {
+        // merge two interleaved halves, as merge_all does; only the merge is
+        // timed, the sets are copied from these before every iteration
+        std::set<PolyCube<SEED_SIZE + 1>> even, odd;
+        for (size_t i{}; i < sorted_children.size(); ++i) {
+            (i % 2 == 0 ? even : odd).insert(sorted_children[i]);
+        }
+        bench.run_timed("std::set merge", [&](auto& timer) {
+            auto a = even, b = odd;
+            timer.start();
+            a.merge(b);
+            timer.stop();
+            keep(a);
+            return (long)sorted_children.size();
+        });
+    }
+
+    for (size_t k : {1, 2, 4, 8, 16}) {
+        // k sorted inputs with the elements dealt out round-robin
+        std::vector<std::vector<PolyCube<SEED_SIZE + 1>>> inputs(k);
+        for (size_t i{}; i < sorted_children.size(); ++i) {
+            inputs[i % k].push_back(sorted_children[i]);
+        }
+        bench.run(std::format("merge_uniq k={}", k), [&] {
+            std::span<PolyCube<SEED_SIZE + 1>> nullspan;
+            long n{};
+            merge_uniq(nullspan, std::span{inputs}, [&](auto const& s) { keep(s); ++n; });
+            return n;
+        });
+    }
+
+    bench.run("PolyCubeListFileWriter", [&] {
+        PolyCubeListFileWriter<SEED_SIZE + 1> writer{out_file};
+        for (auto const& s : sorted_children) writer.write(s);
+        return (long)sorted_children.size();
+    });
+
+    bench.run("PolyCubeListFileReader", [&] {
+        PolyCubeListFileReader reader{out_file};
+        long n{};
+        for (auto const& s : reader.range<SEED_SIZE + 1>()) {
+            keep(s);
+            ++n;
+        }
+        return n;
+    });
+
+    std::filesystem::remove(seed_file);
+    std::filesystem::remove(out_file);
+
+    if (!json_file.empty()) bench.write_json(json_file);
+
+    return 0;
+}
@@ -1,8 +1,15 @@
 #ifndef POLYCUBES_POLYCUBESEARCH_H_
 #define POLYCUBES_POLYCUBESEARCH_H_
 
+#include "boxconstraint.h"
+#include "dynpolycube.h"
+#include "metrics.h"
+#include "numa.h"
+#include "perfcounters.h"
 #include "polycube.h"
 #include "polycubeio.h"
+#include "polycubetrie.h"
+#include "symmetry.h"
 #include "util.h"
 
 #include <algorithm>
@@ -14,7 +21,12 @@
 #include <iostream>
 #include <iterator>
 #include <mutex>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <ranges>
 #include <set>
+#include <span>
 #include <thread>
 
 
@@ -25,44 +37,137 @@ long constexpr input_size_without_cache([[maybe_unused]] size_t SIZE) { return 2
 
 int constexpr MAXIMUM_TOLERATED_CACHE_WAITLIST = 2;
 
+// A sorted, deduplicating container of polycubes, e.g. std::set or PolyCubeTrie
+template<typename C>
+concept PolyCubeSet = PolyCuboid<typename C::value_type>
+    && requires (C c, typename C::value_type const& s) {
+        c.insert(s);
+        c.merge(c);
+        std::begin(c);
+        std::end(c);
+    };
+
+template<PolyCubeSet C>
+size_t constexpr cube_count_of_set = C::value_type::cube_count;
+
+// insert into a std::set or PolyCubeTrie, returns false if it was there already
+template <PolyCubeSet Output>
+bool insert_new(Output& output, typename Output::value_type const& s)
+{
+    auto result = output.insert(s);
+    if constexpr (std::is_same_v<decltype(result), bool>) {
+        return result;
+    } else {
+        return result.second;
+    }
+}
+
 
+// Build the shape with an additional block at coord, unless that cell is
+// already occupied. Returns false if there is no new shape.
 template <size_t SIZE>
-void try_adding_block(PolyCube<SIZE-1> const& orig_shape, Coord const& coord, std::set<PolyCube<SIZE>>& output)
+bool try_adding_block(PolyCube<SIZE-1> const& orig_shape, Coord const& coord, PolyCube<SIZE>& new_shape)
 {
     for (auto const& block : orig_shape.cubes) {
-        if (block == coord) return;
+        if (block == coord) return false;
     }
 
-    PolyCube<SIZE> new_shape;
     std::copy(orig_shape.cubes.begin(), orig_shape.cubes.end(), new_shape.cubes.begin());
     new_shape.cubes[SIZE-1] = coord;
-
-    auto norm_shape = new_shape.normal();
-    output.insert(norm_shape);
+    return true;
 }
 
 
-template <size_t SIZE>
-void find_larger(PolyCube<SIZE-1> const& orig_shape, std::set<PolyCube<SIZE>>& output)
+template <PolyCubeSet Output>
+void find_larger(PolyCube<cube_count_of_set<Output>-1> const& orig_shape, Output& output,
+                 BoxConstraint const& box = {})
 {
+    size_t constexpr SIZE = cube_count_of_set<Output>;
+
+    // Collect all candidates first, so they can be normalized as a batch
+    std::array<PolyCube<SIZE>, 6 * (SIZE - 1)> candidates;
+    size_t n{};
+
+    bool const constrained = !box.unconstrained();
+    BoundingBox const bbox{orig_shape.cubes};
+    // a seed that doesn't fit can't grow into anything that does
+    if (constrained && !bbox.fits(box)) return;
+
+    size_t tried{};
+    auto add = [&](Coord const& coord) {
+        if (constrained && !bbox.fits_with(box, coord)) return;
+        ++tried;
+        n += try_adding_block(orig_shape, coord, candidates[n]);
+    };
+
     for (auto const& block : orig_shape.cubes) {
-        try_adding_block(orig_shape, block + Coord{1, 0, 0}, output);
-        try_adding_block(orig_shape, block + Coord{-1, 0, 0}, output);
-        try_adding_block(orig_shape, block + Coord{0, 1, 0}, output);
-        try_adding_block(orig_shape, block + Coord{0, -1, 0}, output);
-        try_adding_block(orig_shape, block + Coord{0, 0, 1}, output);
-        try_adding_block(orig_shape, block + Coord{0, 0, -1}, output);
+        add(block + Coord{1, 0, 0});
+        add(block + Coord{-1, 0, 0});
+        add(block + Coord{0, 1, 0});
+        add(block + Coord{0, -1, 0});
+        add(block + Coord{0, 0, 1});
+        add(block + Coord{0, 0, -1});
     }
+
+    auto batch = std::span{candidates}.first(n);
+    {
+        ScopedTimer timer{Metric::normalize_ns};
+        normalize_batch<SIZE>(batch, batch);
+    }
+
+    size_t duplicates{};
+    {
+        ScopedTimer timer{Metric::insert_ns};
+        for (auto const& norm_shape : batch) {
+            duplicates += !insert_new(output, norm_shape);
+        }
+    }
+
+    auto& metrics = thread_metrics();
+    metrics.add(Metric::seeds);
+    metrics.add(Metric::candidates, n);
+    metrics.add(Metric::occupied_rejections, tried - n);
+    metrics.add(Metric::duplicates, duplicates);
 }
 
-template <typename T, typename Range>
-void merge_all(std::set<T>& output, Range&& additions)
+template <PolyCubeSet Output, typename Range>
+void merge_all(Output& output, Range&& additions)
 {
+    ScopedTimer timer{Metric::set_merge_ns};
+    PerfScope perf{PerfPhase::local_merge};
     for (auto& addition : additions) {
         output.merge(addition);
     }
 }
 
+// Like merge_all, but on a NUMA machine the additions are first merged on
+// their own node (the one node_for() assigns them), and only the per-node
+// results are merged across nodes. std::set::merge relinks the nodes without
+// moving them, so every shape stays in the memory its worker allocated it
+// in (on the worker's node); what the per-node step keeps local is the
+// merging work, which reads the additions of that node only. The result set
+// is spread over all nodes.
+template <PolyCubeSet Output>
+void merge_all_by_node(Output& output, std::vector<Output>& additions)
+{
+    auto const& numa = NumaTopology::instance();
+    if (!numa.active()) {
+        merge_all(output, additions);
+        return;
+    }
+
+    std::vector<Output> per_node(numa.node_count());
+    std::vector<size_t> nodes(per_node.size());
+    std::iota(nodes.begin(), nodes.end(), 0);
+    std::for_each(std::execution::par, nodes.begin(), nodes.end(), [&](size_t node) {
+        NumaPin pin{node};
+        for (size_t i{}; i < additions.size(); ++i) {
+            if (numa.node_for(i, additions.size()) == node) merge_all(per_node[node], std::span{&additions[i], 1});
+        }
+    });
+    merge_all(output, per_node);
+}
+
 template<typename Iter>
 concept RandomAccessPolyCubeIterator = std::random_access_iterator<Iter>
     && requires (Iter iter) {
@@ -72,8 +177,9 @@ concept RandomAccessPolyCubeIterator = std::random_access_iterator<Iter>
 template<RandomAccessPolyCubeIterator Iter>
 size_t constexpr cube_count_of_iter = std::iterator_traits<Iter>::value_type::cube_count;
 
-template <RandomAccessPolyCubeIterator Iter>
-void find_all_impl(Iter begin, Iter end, std::set<PolyCube<cube_count_of_iter<Iter>+1>>& result)
+template <RandomAccessPolyCubeIterator Iter, PolyCubeSet Output>
+    requires (cube_count_of_set<Output> == cube_count_of_iter<Iter> + 1)
+void find_all_impl(Iter begin, Iter end, Output& result, BoxConstraint const& box = {})
 {
     size_t constexpr SIZE = cube_count_of_iter<Iter> + 1;
     static auto constexpr SERIAL_CHUNK_SIZE = serial_chunk_size(SIZE);
@@ -84,30 +190,49 @@ void find_all_impl(Iter begin, Iter end, std::set<PolyCube<cube_count_of_iter<It
 
     if (count <= SERIAL_CHUNK_SIZE) {
         // Do these all at once, one after the other
+        PerfScope perf{PerfPhase::search};
         for (auto iter = begin; iter != end; ++iter) {
-            find_larger(*iter, result);
+            find_larger(*iter, result, box);
         }
     } else if (count <= PARALLEL_COUNT) {
         // Can do all of these in N parallel chunks
-        // Have to copy because PolyCubeListFileReader iterators are not thread safe
-        std::vector<std::vector<PolyCube<SIZE - 1>>> chunks;
-        for (long i{}; i < count; i += SERIAL_CHUNK_SIZE) {
-            long chunk_len = std::min(count - i, SERIAL_CHUNK_SIZE);
-            auto chunk_begin = begin + i;
-            auto chunk_end = chunk_begin + chunk_len;
-            chunks.push_back(std::vector<PolyCube<SIZE - 1>>(chunk_begin, chunk_end));
-        }
-
-        std::vector<std::set<PolyCube<SIZE>>> sub_results(chunks.size());
-
-        std::vector<long> indices(chunks.size());
+        long const chunk_count = (count + SERIAL_CHUNK_SIZE - 1) / SERIAL_CHUNK_SIZE;
+        std::vector<long> indices(chunk_count);
         std::iota(indices.begin(), indices.end(), 0);
-        std::for_each(std::execution::par, indices.begin(), indices.end(),
-            [&](long i) {
-                find_all_impl(chunks[i].begin(), chunks[i].end(), sub_results[i]);
-            });
-
-        merge_all(result, sub_results);
+        auto const& numa = NumaTopology::instance();
+
+        // Every worker copies its chunk after pinning itself, so that the copy
+        // is allocated (first touched) on its node. Have to copy, and one at a
+        // time, because PolyCubeListFileReader iterators are not thread safe.
+        std::mutex read_mutex;
+        auto read_chunk = [&](long i) {
+            auto chunk_begin = begin + i * SERIAL_CHUNK_SIZE;
+            auto chunk_end = chunk_begin + std::min(count - i * SERIAL_CHUNK_SIZE, SERIAL_CHUNK_SIZE);
+            std::unique_lock lock{read_mutex};
+            return std::vector<PolyCube<SIZE - 1>>(chunk_begin, chunk_end);
+        };
+
+        if constexpr (supports_concurrent_insert<Output>) {
+            // All chunks can insert into the result directly
+            std::for_each(std::execution::par, indices.begin(), indices.end(),
+                [&](long i) {
+                    NumaPin pin{numa.node_for(i, chunk_count)};
+                    auto chunk = read_chunk(i);
+                    find_all_impl(chunk.begin(), chunk.end(), result, box);
+                });
+        } else {
+            std::vector<Output> sub_results(chunk_count);
+
+            std::for_each(std::execution::par, indices.begin(), indices.end(),
+                [&](long i) {
+                    // the set is allocated as it grows, i.e. on this node
+                    NumaPin pin{numa.node_for(i, chunk_count)};
+                    auto chunk = read_chunk(i);
+                    find_all_impl(chunk.begin(), chunk.end(), sub_results[i], box);
+                });
+
+            merge_all_by_node(result, sub_results);
+        }
     } else {
         // Do super-chunks in series
         for (long i{}; i < count; i += PARALLEL_COUNT) {
@@ -115,58 +240,396 @@ void find_all_impl(Iter begin, Iter end, std::set<PolyCube<cube_count_of_iter<It
             auto superchunk_begin = begin + i;
             auto superchunk_end = superchunk_begin + superchunk_len;
 
-            find_all_impl(superchunk_begin, superchunk_end, result);
+            find_all_impl(superchunk_begin, superchunk_end, result, box);
         }
     }
 }
 
-template <RandomAccessPolyCubeIterator Iter>
-std::set<PolyCube<cube_count_of_iter<Iter> + 1>> find_all_one_larger(Iter begin, Iter end)
+template <RandomAccessPolyCubeIterator Iter,
+          PolyCubeSet Output = std::set<PolyCube<cube_count_of_iter<Iter> + 1>>>
+Output find_all_one_larger(Iter begin, Iter end, BoxConstraint const& box = {})
 {
-    size_t constexpr SIZE = cube_count_of_iter<Iter> + 1;
-    std::set<PolyCube<SIZE>> result;
-    find_all_impl(begin, end, result);
+    Output result;
+    find_all_impl(begin, end, result, box);
+    return result;
+}
+
+// Runtime-sized counterpart of find_larger: append the normal forms of all
+// shapes that can be made by adding one block to seed (with duplicates)
+inline void find_larger(DynPolyCube const& seed, PolyCubeArena& output, BoxConstraint const& box = {})
+{
+    static std::array<Coord, 6> const directions{
+        Coord{1, 0, 0}, Coord{-1, 0, 0}, Coord{0, 1, 0},
+        Coord{0, -1, 0}, Coord{0, 0, 1}, Coord{0, 0, -1}};
+
+    auto const n = seed.cube_count();
+    std::array<Coord, MAX_CUBE_COUNT> buf;
+    auto new_shape = std::span{buf}.first(n + 1);
+    std::copy(seed.cubes.begin(), seed.cubes.end(), new_shape.begin());
+
+    bool const constrained = !box.unconstrained();
+    BoundingBox const bbox{seed.cubes};
+    if (constrained && !bbox.fits(box)) return;
+
+    uint64_t candidates{}, occupied{};
+    {
+        ScopedTimer timer{Metric::normalize_ns};
+        for (auto const& block : seed.cubes) {
+            for (auto const& d : directions) {
+                auto coord = block + d;
+                if (constrained && !bbox.fits_with(box, coord)) continue;
+                if (std::find(seed.cubes.begin(), seed.cubes.end(), coord) != seed.cubes.end()) {
+                    ++occupied;
+                    continue;
+                }
+                new_shape[n] = coord;
+                normalize(new_shape, output.push_back());
+                ++candidates;
+            }
+        }
+    }
+
+    auto& metrics = thread_metrics();
+    metrics.add(Metric::seeds);
+    metrics.add(Metric::candidates, candidates);
+    metrics.add(Metric::occupied_rejections, occupied);
+}
+
+// The canonical parent of a normalized shape is the polycube that is left
+// when the last cube (in sorted order) whose removal keeps the shape
+// connected is removed. Such a cube always exists (a leaf of any spanning
+// tree), so every polycube of two or more cubes has exactly one. This writes
+// its cubes to out, not normalized.
+inline void canonical_parent(DynPolyCube const& shape, std::span<Coord> out)
+{
+    auto const n = shape.cube_count();
+    for (size_t i = n; i-- > 0;) {
+        std::copy(shape.cubes.begin(), shape.cubes.begin() + (long)i, out.begin());
+        std::copy(shape.cubes.begin() + (long)i + 1, shape.cubes.end(), out.begin() + (long)i);
+        if (is_connected(out.first(n - 1))) break;
+    }
+}
+
+// sorted extents of the bounding box, the same in every orientation
+inline std::array<int, 3> sorted_extents(std::span<const Coord> shape)
+{
+    auto lo = min_coords(shape);
+    auto hi = max_coords(shape);
+    std::array<int, 3> extents{hi.x() - lo.x(), hi.y() - lo.y(), hi.z() - lo.z()};
+    std::sort(extents.begin(), extents.end());
+    return extents;
+}
+
+// True if seed is the canonical parent of shape (both normalized). Keeping
+// only the shapes a seed is the canonical parent of yields every polycube
+// exactly once, no matter how the seeds are split up.
+inline bool is_canonical_parent(DynPolyCube const& seed, DynPolyCube const& shape)
+{
+    auto const n = shape.cube_count();
+    std::array<Coord, MAX_CUBE_COUNT> sub_buf;
+    auto sub = std::span{sub_buf}.first(n - 1);
+    canonical_parent(shape, sub);
+
+    // most candidates fail this already, without normalizing
+    if (sorted_extents(sub) != sorted_extents(seed.cubes)) return false;
+
+    std::array<Coord, MAX_CUBE_COUNT> normal_buf;
+    auto parent = std::span{normal_buf}.first(n - 1);
+    normalize(sub, parent);
+    return DynPolyCube{parent} == seed;
+}
+
+// number of candidate shapes a worker collects before deduplicating them
+size_t constexpr DYN_PENDING_LIMIT = 1 << 20;
+
+// Runs the seeds through expanders on parallel workers, and returns all the
+// shapes (of cube_count cubes) that they append, deduplicated and sorted.
+// make_expander() is called once per worker, and returns a callable
+// (DynPolyCube const& seed, PolyCubeArena& output) that may keep scratch
+// space between seeds.
+template <typename MakeExpander>
+PolyCubeArena collect_expanded(PolyCubeArena const& seeds, size_t cube_count, MakeExpander make_expander)
+{
+    if (cube_count > MAX_CUBE_COUNT) throw std::invalid_argument("too many cubes");
+
+    // every worker deduplicates its own contiguous range of seeds
+    size_t const worker_count = std::min<size_t>(parallel_chunk_count(), std::max<size_t>(seeds.size(), 1));
+    size_t const per_worker = (seeds.size() + worker_count - 1) / worker_count;
+    std::vector<PolyCubeArena> sub_results(worker_count, PolyCubeArena{cube_count});
+
+    std::vector<size_t> indices(worker_count);
+    std::iota(indices.begin(), indices.end(), 0);
+    auto const& numa = NumaTopology::instance();
+    std::for_each(std::execution::par, indices.begin(), indices.end(),
+        [&](size_t w) {
+            NumaPin pin{numa.node_for(w, worker_count)};
+            PerfScope perf{PerfPhase::search};
+            PolyCubeArena pending{cube_count};
+            // sorted runs, each more than twice as large as the next one, so
+            // that every shape is merged O(log n) times and not once per flush
+            std::vector<PolyCubeArena> runs;
+
+            auto merge_runs = [&](std::span<PolyCubeArena> merging) {
+                size_t before{};
+                for (auto const& run : merging) before += run.size();
+                PolyCubeArena merged{cube_count};
+                std::span<DynPolyCube> nullspan;
+                merge_uniq(nullspan, merging, [&](DynPolyCube const& s) { merged.push_back(s.cubes); });
+                thread_metrics().add(Metric::duplicates, before - merged.size());
+                return merged;
+            };
+
+            auto flush = [&] {
+                ScopedTimer timer{Metric::insert_ns};
+                auto const before = pending.size();
+                pending.sort_unique();
+                thread_metrics().add(Metric::duplicates, before - pending.size());
+                runs.push_back(std::move(pending));
+                pending = PolyCubeArena{cube_count};
+                while (runs.size() >= 2 && runs[runs.size() - 2].size() <= 2 * runs.back().size()) {
+                    auto merged = merge_runs(std::span{runs}.last(2));
+                    runs.pop_back();
+                    runs.back() = std::move(merged);
+                }
+            };
+
+            auto expand = make_expander();
+            auto const begin = std::min(seeds.size(), w * per_worker);
+            auto const end = std::min(seeds.size(), (w + 1) * per_worker);
+            if (numa.active()) {
+                // a copy of this worker's seeds on its own node
+                PolyCubeArena local{seeds.cube_count()};
+                local.push_back(std::span{seeds.data() + begin * seeds.cube_count(), (end - begin) * seeds.cube_count()});
+                for (auto const& seed : local) {
+                    expand(seed, pending);
+                    if (pending.size() >= DYN_PENDING_LIMIT) flush();
+                }
+            } else {
+                for (size_t i = begin; i < end; ++i) {
+                    expand(seeds[i], pending);
+                    if (pending.size() >= DYN_PENDING_LIMIT) flush();
+                }
+            }
+            flush();
+
+            ScopedTimer timer{Metric::insert_ns};
+            sub_results[w] = runs.size() == 1 ? std::move(runs.front()) : merge_runs(runs);
+        });
+
+    PolyCubeArena result{cube_count};
+    PerfScope perf{PerfPhase::local_merge};
+    std::span<DynPolyCube> nullspan;
+    if (numa.active()) {
+        // merge on every node first, then across nodes
+        std::vector<PolyCubeArena> per_node(numa.node_count(), PolyCubeArena{cube_count});
+        std::vector<size_t> nodes(per_node.size());
+        std::iota(nodes.begin(), nodes.end(), 0);
+        std::for_each(std::execution::par, nodes.begin(), nodes.end(), [&](size_t node) {
+            NumaPin pin{node};
+            std::vector<PolyCubeArena> local;
+            for (size_t w{}; w < worker_count; ++w) {
+                if (numa.node_for(w, worker_count) == node) local.push_back(std::move(sub_results[w]));
+            }
+            if (local.empty()) return;
+            merge_uniq(nullspan, std::span{local},
+                [&](DynPolyCube const& s) { per_node[node].push_back(s.cubes); });
+        });
+        sub_results = std::move(per_node);
+    }
+    merge_uniq(nullspan, std::span{sub_results},
+        [&](DynPolyCube const& s) { result.push_back(s.cubes); });
     return result;
 }
 
-template<size_t SIZE>
+// Appends the shapes that are `levels` cubes larger than shape and descend
+// from it through canonical parents only, depth first. Over all seeds of one
+// size, this reaches every polycube exactly once. scratch[k] holds the
+// candidates while k + 1 levels remain.
+inline void grow_depth_first(DynPolyCube const& shape, size_t levels, BoxConstraint const& box,
+                             std::vector<PolyCubeArena>& scratch, PolyCubeArena& output)
+{
+    auto& candidates = scratch[levels - 1];
+    candidates.clear();
+    find_larger(shape, candidates, box);
+    // a symmetric shape reaches some of its children more than once
+    if (levels > 1) candidates.sort_unique();
+
+    for (auto const& child : candidates) {
+        if (!is_canonical_parent(shape, child)) continue;
+        if (levels == 1) {
+            output.push_back(child.cubes);
+        } else {
+            grow_depth_first(child, levels - 1, box, scratch, output);
+        }
+    }
+}
+
+// All distinct shapes `levels` cubes larger than the seeds, sorted, without
+// the intermediate levels. Only the shapes that descend from the seeds
+// through canonical parents are found, so the seeds have to be all the
+// polycubes of their size (that fit into the box) for a complete result.
+inline PolyCubeArena find_all_n_larger(PolyCubeArena const& seeds, size_t levels, BoxConstraint const& box = {})
+{
+    size_t const SIZE = seeds.cube_count() + levels;
+    return collect_expanded(seeds, SIZE, [&] {
+        std::vector<PolyCubeArena> scratch;
+        for (size_t k{}; k < levels; ++k) scratch.emplace_back(SIZE - k);
+        return [&box, levels, scratch = std::move(scratch)](DynPolyCube const& seed, PolyCubeArena& output) mutable {
+            grow_depth_first(seed, levels, box, scratch, output);
+        };
+    });
+}
+
+// Runtime-sized counterpart of find_all_one_larger: all distinct shapes one
+// larger than the seeds, sorted. With canonical_only, only the shapes that
+// one of the seeds is the canonical parent of.
+inline PolyCubeArena find_all_one_larger(PolyCubeArena const& seeds, BoxConstraint const& box = {},
+                                         bool canonical_only = false)
+{
+    if (canonical_only) return find_all_n_larger(seeds, 1, box);
+
+    return collect_expanded(seeds, seeds.cube_count() + 1, [&] {
+        return [&box](DynPolyCube const& seed, PolyCubeArena& output) { find_larger(seed, output, box); };
+    });
+}
+
+// Optional extras for PolyCubeListGenerator
+// Where the time went in a PolyCubeListGenerator run, in seconds
+struct GeneratorTimings
+{
+    // searching (main thread)
+    double compute{};
+    // main thread waiting for the merge worker, including the final merge
+    double wait{};
+    // merging results and writing them to disk (merge worker)
+    double merge{};
+    // classifying symmetries during the final merge (merge worker, not
+    // included in merge)
+    double classify{};
+};
+
+// How many duplicates were removed where, in a PolyCubeListGenerator run
+struct GeneratorDuplicates
+{
+    long chunks{};
+    // shapes found by the search, with duplicates
+    long candidates{};
+    // shapes in the chunk results (duplicates within a chunk removed)
+    long chunk_shapes{};
+    // shapes written (duplicates across chunks removed by the disk merge)
+    long unique{};
+
+    double in_chunk_rate() const { return candidates == 0 ? 0.0 : double(candidates - chunk_shapes) / double(candidates); }
+    double cross_chunk_rate() const { return candidates == 0 ? 0.0 : double(chunk_shapes - unique) / double(candidates); }
+};
+
+struct GeneratorOptions
+{
+    // if set, classify the symmetries of every shape written
+    SymmetryStats* symmetry_stats = nullptr;
+    // if not empty, also write the free polycubes (mirror images identified)
+    // to this file; requires symmetry_stats
+    std::filesystem::path free_outfile{};
+    // only generate polycubes that fit into this box
+    BoxConstraint box{};
+    // if set, report timings here
+    GeneratorTimings* timings = nullptr;
+    // number of levels every seed grows by, depth first in memory without the
+    // intermediate lists; more than 1 needs the runtime-sized engine
+    size_t levels = 1;
+    // seeds per chunk; 0 for the default
+    long chunk_seeds = 0;
+    // if set, report where duplicates were removed here
+    GeneratorDuplicates* duplicates = nullptr;
+};
+
+// Finds all polycubes one larger than a list of seeds, and writes them to a
+// file (deduplicated and sorted). Large inputs are processed in chunks, and
+// the results are merged on disk in a background thread.
+//
+// With SIZE == DYNAMIC_CUBE_COUNT and Container == PolyCubeArena, the cube
+// count is passed at run time instead.
+template<size_t SIZE, typename Container = std::set<PolyCube<SIZE>>>
 class PolyCubeListGenerator
 {
 public:
-    PolyCubeListGenerator(std::filesystem::path outfile)
-    : m_out_file{std::move(outfile)},
+    explicit PolyCubeListGenerator(std::filesystem::path outfile, GeneratorOptions options = {},
+                                   size_t cube_count = SIZE)
+    : m_options{std::move(options)},
+      m_cube_count{cube_count},
+      m_out_file{std::move(outfile)},
       m_cache_file{m_out_file.parent_path() / std::format(".{}.tmp.1", m_out_file.filename().string())},
       m_tmp_cache_file{m_out_file.parent_path() / std::format(".{}.tmp.2", m_out_file.filename().string())}
     {
+        if (m_options.levels == 0) throw std::invalid_argument("levels must be positive");
+        if (m_options.levels > 1 && SIZE != DYNAMIC_CUBE_COUNT) {
+            throw std::invalid_argument("generating several levels at once needs the runtime-sized engine");
+        }
     }
 
     template<typename Iter>
     long operator()(Iter seed_begin, Iter seed_end)
+    {
+        return run(seed_end - seed_begin, [&](long i, long chunk_len) {
+            auto chunk_begin = seed_begin + i;
+            auto chunk_end = chunk_begin + chunk_len;
+            return find_all_one_larger<Iter, Container>(chunk_begin, chunk_end, m_options.box);
+        });
+    }
+
+    // runtime-sized variant
+    long operator()(PolyCubeListFileReader& seeds)
+        requires (SIZE == DYNAMIC_CUBE_COUNT)
+    {
+        return run(seeds.size(), [&](long i, long chunk_len) {
+            PolyCubeArena chunk{m_cube_count - m_options.levels};
+            seeds.read(i, chunk_len, chunk);
+            if (m_options.levels > 1) return find_all_n_larger(chunk, m_options.levels, m_options.box);
+            return find_all_one_larger(chunk, m_options.box);
+        });
+    }
+
+private:
+    template<typename ChunkSearch>
+    long run(long seed_count, ChunkSearch search_chunk)
     {
         // Start the worker thread
         m_count = 0;
-        m_merge_worker_thread = std::jthread{std::bind(&PolyCubeListGenerator<SIZE>::merge_worker, this)};
+        m_duplicates = {};
+        m_merge_worker_thread = std::jthread{std::bind(&PolyCubeListGenerator::merge_worker, this)};
 
         // Start the clock (for logging)
         auto t0 = std::chrono::system_clock::now();
 
-        long seed_count = seed_end - seed_begin;
-        auto chunk_size = input_size_without_cache(SIZE);
+        // every level multiplies the number of shapes by about 8
+        auto chunk_size = m_options.chunk_seeds > 0 ? m_options.chunk_seeds
+            : std::max(1L, input_size_without_cache(m_cube_count) >> std::min<size_t>(3 * (m_options.levels - 1), 21));
 
         for (long i{}; i < seed_count; i += chunk_size) {
             long chunk_len = std::min(seed_count - i, chunk_size);
-
-            auto chunk_begin = seed_begin + i;
-            auto chunk_end = chunk_begin + chunk_len;
-            bool is_last_chunk = chunk_end == seed_end;
+            long chunk_end = i + chunk_len;
+            bool is_last_chunk = chunk_end == seed_count;
 
             // Do the search on this chunk
-            auto chunk_result = find_all_one_larger(chunk_begin, chunk_end);
+            auto t_search = std::chrono::steady_clock::now();
+            auto candidates_before = MetricsRegistry::instance().totals()[static_cast<size_t>(Metric::candidates)];
+            auto chunk_result = search_chunk(i, chunk_len);
+            auto t_handover = std::chrono::steady_clock::now();
+            m_timings.compute += seconds_between(t_search, t_handover);
+            ++m_duplicates.chunks;
+            m_duplicates.candidates += (long)(MetricsRegistry::instance().totals()[static_cast<size_t>(Metric::candidates)]
+                                              - candidates_before);
+            m_duplicates.chunk_shapes += (long)chunk_result.size();
 
             // Hand the result over
             {
+                ScopedTimer timer{Metric::queue_wait_ns};
                 std::unique_lock lock{m_result_mutex};
 
+                // counted once per stall, however often the wait wakes up
+                if (m_result_chunks.size() >= MAXIMUM_TOLERATED_CACHE_WAITLIST) {
+                    thread_metrics().add(Metric::emergency_stops);
+                }
                 while (m_result_chunks.size() >= MAXIMUM_TOLERATED_CACHE_WAITLIST) {
                     // can't add to this list - it's too long already. Wait.
                     std::cout << "EMERGENCY SYNCHRONIZATION STOP\n";
@@ -177,31 +640,37 @@ public:
                 m_result_chunks.emplace_back(std::move(chunk_result));
             }
             m_result_condvar.notify_all();
+            m_timings.wait += seconds_between(t_handover, std::chrono::steady_clock::now());
 
             if (!is_last_chunk || i != 0) {
                 using Duration = std::chrono::system_clock::duration;
                 auto t = std::chrono::system_clock::now();
                 Duration dt = t - t0;
-                auto n_done = chunk_end - seed_begin;
+                auto n_done = chunk_end;
                 auto progress = double(n_done) / double(seed_count);
                 auto expected_duration = Duration{(Duration::rep)(dt.count() * (1.0 / progress))};
                 auto eta = t0 + expected_duration;
 
                 std::cout << std::format("[{0}] generating ({2})-cubes: {3:.3}% ({4}/{5}); ETA (optimistic) {1}\n",
                     strftime_local("%FT%T", t), strftime_local("%R", eta),
-                    SIZE, progress * 100.0, n_done, seed_count);
+                    m_cube_count, progress * 100.0, n_done, seed_count);
             }
         }
         // Wait for the result to be written
+        auto t_join = std::chrono::steady_clock::now();
         m_merge_worker_thread.join();
+        m_timings.wait += seconds_between(t_join, std::chrono::steady_clock::now());
+
+        if (m_options.timings != nullptr) *m_options.timings = m_timings;
+        m_duplicates.unique = m_count;
+        if (m_options.duplicates != nullptr) *m_options.duplicates = m_duplicates;
 
         return m_count;
     }
 
-private:
     void merge_worker()
     {
-        std::vector<std::set<PolyCube<SIZE>>> new_chunks;
+        std::vector<Container> new_chunks;
         bool done = false;
 
         while (!done) {
@@ -226,7 +695,16 @@ private:
             }
 
 
-            if (!new_chunks.empty()) merge_results(new_chunks);
+            // the last chunk is in this batch: this merge produces the final result
+            if (!new_chunks.empty()) {
+                auto t_merge = std::chrono::steady_clock::now();
+                auto const classify_before = m_timings.classify;
+                ScopedTimer timer{Metric::disk_merge_ns};
+                PerfScope perf{PerfPhase::disk_merge};
+                merge_results(new_chunks, done);
+                m_timings.merge += seconds_between(t_merge, std::chrono::steady_clock::now())
+                    - (m_timings.classify - classify_before);
+            }
         }
 
         // commit the result
@@ -235,27 +713,42 @@ private:
         }
     }
 
-    void merge_results(std::vector<std::set<PolyCube<SIZE>>>& new_chunks)
+    void merge_results(std::vector<Container>& new_chunks, bool is_final)
     {
         auto old_count = m_count;
         {
             auto new_chunks_span = std::span{new_chunks};
-            PolyCubeListFileWriter<SIZE> cache_out{m_tmp_cache_file};
+            auto cache_out = make_writer(m_tmp_cache_file);
+
+            // Symmetries are only classified in the final merge, when every
+            // shape passes through here exactly once (in parallel batches)
+            std::optional<SymmetryClassifier> classifier;
+            if (is_final && m_options.symmetry_stats != nullptr) classifier.emplace(m_cube_count, m_options.free_outfile);
 
             m_count = 0;
 
             auto output_func = [&](auto const& pc) {
                 ++m_count;
                 cache_out.write(pc);
+                if (classifier) classifier->add(pc);
             };
 
             if (old_count == 0) {
                 // first chunk(s)
-                std::span<PolyCube<SIZE>> nullspan;
+                std::span<typename Container::value_type> nullspan;
                 merge_uniq(nullspan, new_chunks_span, output_func);
             } else {
                 PolyCubeListFileReader cache{m_cache_file};
-                merge_uniq(cache.range<SIZE>(), new_chunks_span, output_func);
+                if constexpr (SIZE == DYNAMIC_CUBE_COUNT) {
+                    merge_uniq(cache.dyn_range(), new_chunks_span, output_func);
+                } else {
+                    merge_uniq(cache.range<SIZE>(), new_chunks_span, output_func);
+                }
+            }
+
+            if (classifier) {
+                *m_options.symmetry_stats = classifier->finish();
+                m_timings.classify += classifier->seconds();
             }
         }
 
@@ -264,12 +757,24 @@ private:
         if (!(old_count == 0 && m_done)) {
             std::cout << std::format("[{}] wrote {} ({})-cubes to disk (was {})\n",
                 strftime_local("%FT%T", std::chrono::system_clock::now()),
-                m_count, SIZE, old_count);
+                m_count, m_cube_count, old_count);
         }
 
         new_chunks.clear();
     }
 
+    auto make_writer(std::filesystem::path const& path) const
+    {
+        if constexpr (SIZE == DYNAMIC_CUBE_COUNT) {
+            return DynPolyCubeListFileWriter{path, m_cube_count};
+        } else {
+            return PolyCubeListFileWriter<SIZE>{path};
+        }
+    }
+
+    GeneratorOptions m_options;
+    size_t m_cube_count;
+
     std::filesystem::path m_out_file;
     std::filesystem::path m_cache_file;
     std::filesystem::path m_tmp_cache_file;
@@ -278,20 +783,37 @@ private:
     std::mutex m_result_mutex;
     std::condition_variable m_result_condvar;
     long m_count{};
+    // compute and wait are only touched by the main thread, merge only by
+    // the merge worker
+    GeneratorTimings m_timings{};
+    // only touched by the main thread
+    GeneratorDuplicates m_duplicates{};
 
-    std::vector<std::set<PolyCube<SIZE>>> m_result_chunks;
+    std::vector<Container> m_result_chunks;
     bool m_done{};
 };
 
-template <RandomAccessPolyCubeIterator Iter>
-long gen_polycube_list(Iter seed_begin, Iter seed_end, std::filesystem::path outfile)
+template <RandomAccessPolyCubeIterator Iter,
+          PolyCubeSet Container = std::set<PolyCube<cube_count_of_iter<Iter> + 1>>>
+long gen_polycube_list(Iter seed_begin, Iter seed_end, std::filesystem::path outfile,
+                       GeneratorOptions const& options = {})
 {
     size_t constexpr SIZE = cube_count_of_iter<Iter> + 1;
 
-    PolyCubeListGenerator<SIZE> gen{outfile};
+    PolyCubeListGenerator<SIZE, Container> gen{outfile, options};
 
     return gen(seed_begin, seed_end);
 }
 
+// runtime-sized variant: works for any cube count
+inline long gen_polycube_list(PolyCubeListFileReader& seeds, std::filesystem::path outfile,
+                              GeneratorOptions const& options = {})
+{
+    PolyCubeListGenerator<DYNAMIC_CUBE_COUNT, PolyCubeArena> gen{outfile, options,
+                                                                (size_t)seeds.cube_count() + options.levels};
+
+    return gen(seeds);
+}
+
 
 #endif // POLYCUBES_POLYCUBESEARCH_H_
@@ -0,0 +1,149 @@
+#include "dynpolycube.h"
+#include "polycubeio.h"
+#include "shapestats.h"
+#include "util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <execution>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <numeric>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Statistics over a polycube list in one pass. The list is split into
+// ranges that are read and analysed in parallel, every range through its
+// own reader, into its own ShapeStats.
+
+// shapes read at once
+size_t constexpr STATS_BLOCK_SIZE = 65536;
+
+// Lists of up to this many cubes per shape are classified with the batched
+// (compile-time sized) symmetry kernel, larger ones shape by shape
+#ifndef POLYCUBES_MAX_STATIC_SIZE
+#define POLYCUBES_MAX_STATIC_SIZE 18
+#endif
+
+template <size_t SIZE>
+struct add_block_impl
+{
+    void operator()(ShapeStats& stats, PolyCubeArena const& block)
+    {
+        if constexpr (SIZE == 0) {
+            for (auto const& s : block) stats.add(s.cubes);
+        } else {
+            stats.add_batch<SIZE>({block.data(), block.size() * SIZE});
+        }
+    }
+};
+
+void add_block(ShapeStats& stats, PolyCubeArena const& block)
+{
+    auto const cube_count = block.cube_count();
+    metaswitch<size_t, POLYCUBES_MAX_STATIC_SIZE, add_block_impl>{}(
+        cube_count > POLYCUBES_MAX_STATIC_SIZE ? 0 : cube_count, stats, block);
+}
+
+ShapeStats collect_stats(std::filesystem::path const& file, bool with_symmetry)
+{
+    PolyCubeListFileReader header{file};
+    auto const shape_count = header.size();
+    auto const cube_count = (size_t)header.cube_count();
+
+    // a few ranges per thread, to even out the load
+    size_t const range_count = std::max<size_t>(1, std::min<size_t>(
+        4 * std::max(1u, std::thread::hardware_concurrency()), shape_count / STATS_BLOCK_SIZE));
+    size_t const per_range = (shape_count + range_count - 1) / range_count;
+
+    std::vector<ShapeStats> partial(range_count);
+    std::vector<size_t> indices(range_count);
+    std::iota(indices.begin(), indices.end(), 0);
+
+    std::for_each(std::execution::par, indices.begin(), indices.end(), [&](size_t r) {
+        auto& stats = partial[r];
+        stats.with_symmetry = with_symmetry;
+
+        PolyCubeListFileReader reader{file};
+        PolyCubeArena block{cube_count};
+        auto const end = std::min(shape_count, (r + 1) * per_range);
+        for (size_t first = r * per_range; first < end; first += STATS_BLOCK_SIZE) {
+            reader.read(first, std::min(STATS_BLOCK_SIZE, end - first), block);
+            add_block(stats, block);
+        }
+    });
+
+    ShapeStats result;
+    result.with_symmetry = with_symmetry;
+    for (auto const& p : partial) result.merge(p);
+    return result;
+}
+
+void print_stats(size_t cube_count, ShapeStats const& stats)
+{
+    std::cout << std::format("{} ({})-cubes\n", stats.shapes, cube_count);
+
+    std::cout << "\nbounding box (sorted extents): shapes\n";
+    for (auto const& [box, n] : stats.bounding_boxes) {
+        std::cout << std::format("  {}x{}x{}: {}\n", box[0], box[1], box[2], n);
+    }
+
+    std::cout << "\nsurface area (exposed faces): shapes\n";
+    for (auto const& [area, n] : stats.surface_areas) {
+        std::cout << std::format("  {}: {}\n", area, n);
+    }
+
+    std::cout << "\nface neighbours: cubes\n";
+    for (size_t k{}; k < stats.neighbour_counts.size(); ++k) {
+        if (stats.neighbour_counts[k] != 0) std::cout << std::format("  {}: {}\n", k, stats.neighbour_counts[k]);
+    }
+
+    if (stats.with_symmetry) {
+        std::cout << std::format("\nsymmetry: {} free, {} achiral\n", stats.symmetry.free, stats.symmetry.achiral);
+        std::cout << "symmetry group order: shapes\n";
+        for (auto const& [order, n] : stats.symmetry.orders) {
+            std::cout << std::format("  {}: {}\n", order, n);
+        }
+    }
+}
+
+int main(int argc, char const* const* argv)
+{
+    using namespace std::string_view_literals;
+
+    std::filesystem::path infile;
+    bool with_symmetry = true;
+
+    for (int i{1}; i < argc; ++i) {
+        std::string_view arg{argv[i]};
+
+        if (arg == "-h"sv || arg == "--help"sv) {
+            std::cout << std::format("Usage: {} [--no-symmetry] INFILE\n", argv[0]);
+            return 0;
+        } else if (arg == "--no-symmetry"sv) {
+            with_symmetry = false;
+        } else if (infile.empty()) {
+            infile = arg;
+        } else {
+            std::cerr << "Invalid argument count\n";
+            return 2;
+        }
+    }
+
+    if (infile.empty()) {
+        std::cerr << "Invalid argument count\n";
+        return 2;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    auto stats = collect_stats(infile, with_symmetry);
+    auto dt = seconds_between(t0, std::chrono::steady_clock::now());
+
+    print_stats((size_t)PolyCubeListFileReader{infile}.cube_count(), stats);
+
+    auto const mb = (double)std::filesystem::file_size(infile) / (1024.0 * 1024.0);
+    std::cout << std::format("\n{:.1f} MB in {:.2f} s ({:.1f} MB/s)\n", mb, dt, dt > 0 ? mb / dt : 0.0);
+    return 0;
+}
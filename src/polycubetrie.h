@@ -0,0 +1,307 @@
+#ifndef POLYCUBES_POLYCUBETRIE_H_
+#define POLYCUBES_POLYCUBETRIE_H_
+
+#include "polycube.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// A set of normalized polycubes, stored as a prefix tree over the (sorted)
+// coordinate lists. Normalized shapes share long prefixes with their
+// neighbours, so each shared prefix is only stored once; a leaf costs one
+// small Entry instead of a full copy of the shape plus a std::set node.
+//
+// A hash of all but the last HASH_SKIP coordinates selects one of SHARD_COUNT
+// shards, each shard being a trie with its own lock and node arena, so
+// insert() can be called from many threads at once. (The leading coordinates
+// of normalized shapes take very few values, so sharding by them sent most
+// shapes to one shard; leaving out the last ones keeps shapes that share all
+// but their last cubes, and so most trie nodes, in the same shard.)
+// Iteration merges the shards and is in the same order as
+// std::set<PolyCube<SIZE>>, but must not run concurrently with insertion.
+template <size_t SIZE>
+class PolyCubeTrie
+{
+    static size_t constexpr SHARD_BITS = 6;
+    static size_t constexpr HASH_SKIP = SIZE > 4 ? 2 : 0;
+
+public:
+    static size_t constexpr SHARD_COUNT = size_t{1} << SHARD_BITS;
+
+private:
+    struct Entry
+    {
+        Coord key;
+        uint32_t child; // index of the next node in the arena (unused at the last level)
+    };
+
+    using Node = std::vector<Entry>;
+
+    // aligned so that the locks of neighbouring shards don't share a cache line
+    struct alignas(64) Shard
+    {
+        std::mutex mutex;
+        std::vector<Node> nodes = std::vector<Node>(1); // nodes[0] is the root of this shard
+        size_t size{};
+    };
+
+    using Shards = std::array<Shard, SHARD_COUNT>;
+
+    // FNV-1a, top bits
+    static size_t shard_of(PolyCube<SIZE> const& s)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i{}; i < SIZE - HASH_SKIP; ++i) {
+            for (auto v : s.cubes[i].xyz) hash = (hash ^ (uint8_t)v) * 1099511628211ull;
+        }
+        return hash >> (64 - SHARD_BITS);
+    }
+
+public:
+    using value_type = PolyCube<SIZE>;
+
+    PolyCubeTrie() = default;
+    PolyCubeTrie(PolyCubeTrie const&) = delete;
+    PolyCubeTrie& operator=(PolyCubeTrie const&) = delete;
+
+    // not thread safe; other is left empty
+    PolyCubeTrie(PolyCubeTrie&& other)
+        : m_shards{std::exchange(other.m_shards, std::make_unique<Shards>())}
+    {
+    }
+
+    // not thread safe; other is left empty
+    PolyCubeTrie& operator=(PolyCubeTrie&& other)
+    {
+        m_shards = std::exchange(other.m_shards, std::make_unique<Shards>());
+        return *this;
+    }
+
+    // returns true if the shape was not in the set before
+    bool insert(PolyCube<SIZE> const& s)
+    {
+        auto& shard = (*m_shards)[shard_of(s)];
+        std::unique_lock lock{shard.mutex};
+        auto& nodes = shard.nodes;
+        uint32_t node_idx = 0;
+        for (size_t depth = 0; depth < SIZE; ++depth) {
+            auto const& coord = s.cubes[depth];
+            bool const is_leaf = depth + 1 == SIZE;
+            auto& node = nodes[node_idx];
+            auto pos = std::lower_bound(node.begin(), node.end(), coord,
+                [](Entry const& e, Coord const& c) { return e.key < c; });
+
+            if (pos != node.end() && pos->key == coord) {
+                if (is_leaf) return false;
+                node_idx = pos->child;
+            } else {
+                uint32_t child{};
+                if (!is_leaf) {
+                    child = static_cast<uint32_t>(nodes.size());
+                }
+                // insert before growing the arena: that invalidates `node`
+                node.insert(pos, Entry{coord, child});
+                if (!is_leaf) {
+                    nodes.emplace_back();
+                    node_idx = child;
+                }
+            }
+        }
+        // counted per shard only: a shared counter would be one contended
+        // cache line for all inserting threads
+        ++shard.size;
+        return true;
+    }
+
+    // move all shapes from other into this set (like std::set::merge, but
+    // other is left empty)
+    void merge(PolyCubeTrie& other)
+    {
+        for (auto const& s : other) {
+            insert(s);
+        }
+        other.clear();
+    }
+
+    // not thread safe
+    void clear()
+    {
+        for (auto& shard : *m_shards) {
+            shard.nodes.assign(1, Node{});
+            shard.size = 0;
+        }
+    }
+
+    // not thread safe while inserting
+    size_t size() const
+    {
+        size_t total{};
+        for (auto const& shard : *m_shards) total += shard.size;
+        return total;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    // number of shapes in each shard, to check how evenly inserting threads
+    // are spread over the locks
+    std::vector<size_t> shard_sizes() const
+    {
+        std::vector<size_t> sizes;
+        for (auto const& shard : *m_shards) sizes.push_back(shard.size);
+        return sizes;
+    }
+
+    // approximate number of bytes of heap memory in use
+    size_t memory_usage() const
+    {
+        size_t total = sizeof(Shards);
+        for (auto const& shard : *m_shards) {
+            total += shard.nodes.capacity() * sizeof(Node);
+            for (auto const& node : shard.nodes) {
+                total += node.capacity() * sizeof(Entry);
+            }
+        }
+        return total;
+    }
+
+private:
+    // position in one shard: the node and entry index at every depth
+    struct Cursor
+    {
+        std::vector<Node> const* nodes;
+        std::array<uint32_t, SIZE> node{};
+        std::array<uint32_t, SIZE> pos{};
+        PolyCube<SIZE> current{};
+
+        // follow the first child of every node from depth onward
+        void descend(size_t depth)
+        {
+            for (; depth < SIZE; ++depth) {
+                auto const& entry = (*nodes)[node[depth]][0];
+                pos[depth] = 0;
+                current.cubes[depth] = entry.key;
+                if (depth + 1 < SIZE) node[depth + 1] = entry.child;
+            }
+        }
+
+        // returns false when the shard is exhausted
+        bool advance()
+        {
+            for (size_t d = SIZE; d-- > 0; ) {
+                auto const& n = (*nodes)[node[d]];
+                if (pos[d] + 1 < n.size()) {
+                    auto const& entry = n[++pos[d]];
+                    current.cubes[d] = entry.key;
+                    if (d + 1 < SIZE) {
+                        node[d + 1] = entry.child;
+                        descend(d + 1);
+                    }
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+public:
+    // Merges the shards with a heap of shard cursors
+    class Iter
+    {
+    public:
+        using value_type = PolyCube<SIZE>;
+        using reference = value_type const&;
+        using pointer = value_type const*;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        Iter() = default;
+
+        explicit Iter(size_t index) : m_index{index} {}
+
+        explicit Iter(Shards const& shards)
+        {
+            for (auto const& shard : shards) {
+                if (shard.size == 0) continue;
+                Cursor cursor{&shard.nodes};
+                cursor.descend(0);
+                m_cursors.push_back(cursor);
+                m_heap.push_back((uint8_t)(m_cursors.size() - 1));
+            }
+            for (size_t i = m_heap.size() / 2; i-- > 0; ) sift_down(i);
+        }
+
+        reference operator*() const { return m_cursors[m_heap.front()].current; }
+        pointer operator->() const { return &**this; }
+
+        Iter& operator++()
+        {
+            // mostly the next shape is in the same shard, and the cursor
+            // stays on top
+            if (!m_cursors[m_heap.front()].advance()) {
+                m_heap.front() = m_heap.back();
+                m_heap.pop_back();
+            }
+            if (!m_heap.empty()) sift_down(0);
+            ++m_index;
+            return *this;
+        }
+
+        Iter operator++(int)
+        {
+            auto copy = *this;
+            ++(*this);
+            return copy;
+        }
+
+        // iterators of the same set are at the same shape after the same
+        // number of steps
+        bool operator==(Iter const& other) const { return m_index == other.m_index; }
+        bool operator!=(Iter const& other) const { return !(*this == other); }
+
+    private:
+        // The coordinates of normalized shapes are not negative, so
+        // comparing the bytes gives the same order as operator<
+        bool less(uint8_t a, uint8_t b) const
+        {
+            return std::memcmp(m_cursors[a].current.cubes.data(), m_cursors[b].current.cubes.data(),
+                       sizeof(m_cursors[a].current.cubes)) < 0;
+        }
+
+        // restore the min-heap order below position i
+        void sift_down(size_t i)
+        {
+            for (;;) {
+                auto smallest = i;
+                for (auto child : {2 * i + 1, 2 * i + 2}) {
+                    if (child < m_heap.size() && less(m_heap[child], m_heap[smallest])) smallest = child;
+                }
+                if (smallest == i) return;
+                std::swap(m_heap[i], m_heap[smallest]);
+                i = smallest;
+            }
+        }
+
+        std::vector<Cursor> m_cursors;
+        std::vector<uint8_t> m_heap;
+        size_t m_index{};
+    };
+
+    Iter begin() const { return Iter{*m_shards}; }
+    Iter end() const { return Iter{size()}; }
+
+private:
+    std::unique_ptr<Shards> m_shards = std::make_unique<Shards>();
+};
+
+// Containers that can safely be inserted into from several threads at once
+template<typename T> bool constexpr supports_concurrent_insert = false;
+template<size_t SIZE> bool constexpr supports_concurrent_insert<PolyCubeTrie<SIZE>> = true;
+
+#endif // POLYCUBES_POLYCUBETRIE_H_
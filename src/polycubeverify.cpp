@@ -0,0 +1,234 @@
+#include "dynpolycube.h"
+#include "polycube.h"
+#include "polycubeio.h"
+#include "util.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <execution>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Checks that a polycube list is intact: strictly sorted (so no duplicates),
+// every shape in normal form and face-connected, and the number of shapes
+// as expected (for complete lists, or when given). The file is memory-mapped
+// and checked in parallel ranges; the order is also checked across range
+// boundaries.
+
+// Lists of up to this many cubes per shape are normalized in batches with
+// the compile-time sized normalize_batch, larger ones shape by shape
+#ifndef POLYCUBES_MAX_STATIC_SIZE
+#define POLYCUBES_MAX_STATIC_SIZE 18
+#endif
+
+enum class Problem
+{
+    none,
+    not_sorted,
+    duplicate,
+    not_normal,
+    not_connected,
+};
+
+char const* problem_text(Problem p)
+{
+    switch (p) {
+    case Problem::none: return "ok";
+    case Problem::not_sorted: return "not sorted (smaller than the shape before it)";
+    case Problem::duplicate: return "duplicate of the shape before it";
+    case Problem::not_normal: return "not in normal form";
+    case Problem::not_connected: return "not face-connected";
+    }
+    return "";
+}
+
+// normal: the normal form of shape i
+Problem check_shape(MappedPolyCubeList const& list, size_t i, std::span<const Coord> normal)
+{
+    auto const s = list[i];
+    if (i != 0) {
+        auto const prev = list[i - 1];
+        if (s == prev) return Problem::duplicate;
+        if (s < prev) return Problem::not_sorted;
+    }
+
+    if (!std::equal(normal.begin(), normal.end(), s.cubes.begin())) return Problem::not_normal;
+
+    if (!is_connected(s.cubes)) return Problem::not_connected;
+    return Problem::none;
+}
+
+struct VerifyResult
+{
+    size_t first_bad = std::numeric_limits<size_t>::max();
+    Problem problem = Problem::none;
+};
+
+// Whether the file is named like a complete list of one-sided polycubes from
+// polycubegen. Box-constrained (_boxAxBxC) and free (_free) lists, or lists
+// named otherwise, have no known count.
+bool is_complete_list(std::filesystem::path const& file, size_t cube_count)
+{
+    return file.filename() == std::format("polycubes_{}.bin", cube_count);
+}
+
+// shapes normalized at once by check_range
+size_t constexpr CHECK_BLOCK_SIZE = 1024;
+
+// Checks the shapes [begin, end) in order and returns the first problem.
+// Stops early (without a problem) once it is past first_bad.
+template <size_t SIZE>
+struct check_range_impl
+{
+    VerifyResult operator()(MappedPolyCubeList const& list, size_t begin, size_t end,
+        std::atomic<size_t> const& first_bad)
+    {
+        std::vector<PolyCube<SIZE>> shapes, normals;
+        for (size_t block = begin; block < end; block += CHECK_BLOCK_SIZE) {
+            if (block > first_bad.load(std::memory_order_relaxed)) break;
+
+            auto const n = std::min(CHECK_BLOCK_SIZE, end - block);
+            shapes.resize(n);
+            normals.resize(n);
+            for (size_t j{}; j < n; ++j) std::ranges::copy(list[block + j].cubes, shapes[j].cubes.begin());
+            normalize_batch<SIZE>(shapes, normals);
+
+            for (size_t j{}; j < n; ++j) {
+                auto problem = check_shape(list, block + j, normals[j].cubes);
+                if (problem != Problem::none) return {block + j, problem};
+            }
+        }
+        return {};
+    }
+};
+
+template <>
+struct check_range_impl<0>
+{
+    VerifyResult operator()(MappedPolyCubeList const& list, size_t begin, size_t end,
+        std::atomic<size_t> const& first_bad)
+    {
+        std::array<Coord, MAX_CUBE_COUNT> buf;
+        auto normal = std::span{buf}.first(list.cube_count());
+        for (size_t i = begin; i < end; ++i) {
+            if (i > first_bad.load(std::memory_order_relaxed)) break;
+            normalize(list[i].cubes, normal);
+            auto problem = check_shape(list, i, normal);
+            if (problem != Problem::none) return {i, problem};
+        }
+        return {};
+    }
+};
+
+VerifyResult check_range(MappedPolyCubeList const& list, size_t begin, size_t end, std::atomic<size_t> const& first_bad)
+{
+    auto const cube_count = list.cube_count();
+    return metaswitch<size_t, POLYCUBES_MAX_STATIC_SIZE, check_range_impl>{}(
+        cube_count > POLYCUBES_MAX_STATIC_SIZE ? 0 : cube_count, list, begin, end, first_bad);
+}
+
+VerifyResult verify(MappedPolyCubeList const& list)
+{
+    size_t constexpr RANGE_SIZE = 65536;
+    auto const range_count = (list.size() + RANGE_SIZE - 1) / RANGE_SIZE;
+
+    // the first bad index found so far; ranges after it are skipped
+    std::atomic<size_t> first_bad{std::numeric_limits<size_t>::max()};
+    std::vector<Problem> problems(range_count, Problem::none);
+    std::vector<size_t> bad_index(range_count, std::numeric_limits<size_t>::max());
+
+    std::vector<size_t> ranges(range_count);
+    std::iota(ranges.begin(), ranges.end(), 0);
+    std::for_each(std::execution::par, ranges.begin(), ranges.end(), [&](size_t r) {
+        auto const begin = r * RANGE_SIZE;
+        auto const end = std::min(list.size(), begin + RANGE_SIZE);
+        auto [i, problem] = check_range(list, begin, end, first_bad);
+        if (problem != Problem::none) {
+            problems[r] = problem;
+            bad_index[r] = i;
+            auto current = first_bad.load();
+            while (i < current && !first_bad.compare_exchange_weak(current, i)) {}
+        }
+    });
+
+    VerifyResult result;
+    for (size_t r{}; r < range_count; ++r) {
+        if (problems[r] != Problem::none) {
+            result.first_bad = bad_index[r];
+            result.problem = problems[r];
+            break;
+        }
+    }
+    return result;
+}
+
+int main(int argc, char const* const* argv)
+{
+    using namespace std::string_view_literals;
+
+    std::filesystem::path infile;
+    // -1: the known number of polycubes for complete lists, 0: don't check
+    long expected_count = -1;
+
+    for (int i{1}; i < argc; ++i) {
+        std::string_view arg{argv[i]};
+
+        if (arg == "-h"sv || arg == "--help"sv) {
+            std::cout << std::format("Usage: {} [--count N | --no-count] INFILE\n", argv[0]);
+            return 0;
+        } else if (arg == "--count"sv && i + 1 < argc) {
+            expected_count = std::strtol(argv[++i], nullptr, 10);
+        } else if (arg == "--no-count"sv) {
+            expected_count = 0;
+        } else if (infile.empty()) {
+            infile = arg;
+        } else {
+            std::cerr << "Invalid argument count\n";
+            return 2;
+        }
+    }
+
+    if (infile.empty()) {
+        std::cerr << "Invalid argument count\n";
+        return 2;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    MappedPolyCubeList list{infile};
+    bool ok = true;
+
+    if (list.trailing_bytes() != 0) {
+        std::cout << std::format("{} trailing bytes after the last shape (truncated file?)\n", list.trailing_bytes());
+        ok = false;
+    }
+
+    auto result = verify(list);
+    if (result.problem != Problem::none) {
+        std::cout << std::format("shape {}: {}\n  ", result.first_bad, problem_text(result.problem))
+                  << list[result.first_bad] << '\n';
+        ok = false;
+    }
+
+    if (expected_count < 0) {
+        expected_count = is_complete_list(infile, list.cube_count()) ? known_polycube_count(list.cube_count()) : 0;
+    }
+    if (expected_count > 0 && (long)list.size() != expected_count) {
+        std::cout << std::format("{} shapes, expected {}\n", list.size(), expected_count);
+        ok = false;
+    }
+
+    auto dt = seconds_between(t0, std::chrono::steady_clock::now());
+    auto const mb = (double)list.size() * list.cube_count() * sizeof(Coord) / (1024.0 * 1024.0);
+    std::cout << std::format("{}: {} ({})-cubes, {} ({:.1f} MB in {:.2f} s)\n", infile.string(), list.size(),
+        list.cube_count(), ok ? "OK" : "FAILED", mb, dt);
+    return ok ? 0 : 1;
+}
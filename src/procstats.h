@@ -0,0 +1,69 @@
+#ifndef POLYCUBES_PROCSTATS_H_
+#define POLYCUBES_PROCSTATS_H_
+
+#include <fstream>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#define POLYCUBES_HAVE_GETRUSAGE 1
+#else
+#define POLYCUBES_HAVE_GETRUSAGE 0
+#endif
+
+// Resource usage of this process so far. Values that aren't available on the
+// current platform are left at -1.
+struct ProcessStats
+{
+    // user + system CPU time of all threads
+    double cpu_seconds = -1;
+    // bytes read and written through system calls (including cached I/O)
+    long read_bytes = -1;
+    long written_bytes = -1;
+    // peak resident set size (since the last reset_peak_rss())
+    long peak_rss_kb = -1;
+
+    static ProcessStats now()
+    {
+        ProcessStats result;
+#if POLYCUBES_HAVE_GETRUSAGE
+        struct rusage usage{};
+        if (getrusage(RUSAGE_SELF, &usage) == 0) {
+            result.cpu_seconds = double(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)
+                + 1e-6 * double(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+#ifdef __APPLE__
+            result.peak_rss_kb = usage.ru_maxrss / 1024;
+#else
+            result.peak_rss_kb = usage.ru_maxrss;
+#endif
+        }
+#endif
+#ifdef __linux__
+        // /proc has the I/O counters, and a peak RSS that can be reset
+        std::ifstream io{"/proc/self/io"};
+        std::string key;
+        long value;
+        while (io >> key >> value) {
+            if (key == "rchar:") result.read_bytes = value;
+            else if (key == "wchar:") result.written_bytes = value;
+        }
+        std::ifstream status{"/proc/self/status"};
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.starts_with("VmHWM:")) result.peak_rss_kb = std::stol(line.substr(6));
+        }
+#endif
+        return result;
+    }
+
+    // start measuring the peak RSS afresh (Linux only)
+    static void reset_peak_rss()
+    {
+#ifdef __linux__
+        std::ofstream clear_refs{"/proc/self/clear_refs"};
+        clear_refs << "5\n";
+#endif
+    }
+};
+
+#endif // POLYCUBES_PROCSTATS_H_
@@ -0,0 +1,93 @@
+#ifndef POLYCUBES_SEEDORDER_H_
+#define POLYCUBES_SEEDORDER_H_
+
+#include "dynpolycube.h"
+#include "polycubeio.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <compare>
+#include <cstdint>
+#include <execution>
+#include <filesystem>
+#include <span>
+#include <utility>
+#include <vector>
+
+// The generator splits the seeds into chunks in file order, and only the
+// duplicates within a chunk are removed before the disk merge. A shape with
+// k removable cubes is found from k seeds, and two seeds that are one cube
+// apart from the same smaller shape (siblings) share children. Ordering the
+// seeds by their smallest sub-polycube puts siblings into the same chunk.
+
+// Sort key for a seed: its smallest sub-polycube (one cube fewer, normalized),
+// as a prefix of its coordinates that keeps their order and a hash of the
+// rest. Siblings get the same key.
+struct SeedKey
+{
+    uint64_t prefix{};
+    uint64_t hash{};
+
+    auto operator<=>(SeedKey const&) const = default;
+};
+
+inline SeedKey seed_key(std::span<const Coord> shape)
+{
+    auto const n = shape.size();
+    if (n < 2) return {};
+
+    std::array<Coord, MAX_CUBE_COUNT> sub_buf, normal_buf, smallest_buf;
+    auto sub = std::span{sub_buf}.first(n - 1);
+    auto normal = std::span{normal_buf}.first(n - 1);
+    auto smallest = std::span{smallest_buf}.first(n - 1);
+    bool found = false;
+    for (size_t i{}; i < n; ++i) {
+        std::copy(shape.begin(), shape.begin() + (long)i, sub.begin());
+        std::copy(shape.begin() + (long)i + 1, shape.end(), sub.begin() + (long)i);
+        if (!is_connected(sub)) continue;
+        normalize(sub, normal);
+        if (!found || DynPolyCube{normal} < DynPolyCube{smallest}) {
+            std::copy(normal.begin(), normal.end(), smallest.begin());
+            found = true;
+        }
+    }
+
+    // the coordinates of a normalized shape are all below n - 1
+    int const bits = std::max(1, (int)std::bit_width(n - 2));
+    SeedKey key{};
+    int used{};
+    uint64_t hash = 14695981039346656037ull;
+    for (auto const& c : smallest) {
+        for (auto v : c.xyz) {
+            if (used + bits <= 64) {
+                key.prefix = (key.prefix << bits) | (uint64_t)v;
+                used += bits;
+            }
+            hash = (hash ^ (uint8_t)v) * 1099511628211ull;
+        }
+    }
+    if (used < 64) key.prefix <<= 64 - used;
+    key.hash = hash;
+    return key;
+}
+
+// Writes the seeds of seed_file to outfile, ordered by seed_key(). Seeds with
+// the same key stay in their sorted order. Needs 24 bytes of memory per seed.
+inline void write_grouped_seeds(std::filesystem::path const& seed_file, std::filesystem::path const& outfile)
+{
+    MappedPolyCubeList seeds{seed_file};
+
+    // filled in place, the index of an entry is its position in order
+    std::vector<std::pair<SeedKey, uint64_t>> order(seeds.size());
+    std::for_each(std::execution::par, order.begin(), order.end(), [&](auto& entry) {
+        auto const i = (uint64_t)(&entry - order.data());
+        entry = {seed_key(seeds[i].cubes), i};
+    });
+    std::sort(std::execution::par, order.begin(), order.end());
+
+    DynPolyCubeListFileWriter out{outfile, seeds.cube_count()};
+    for (auto const& [key, i] : order) out.write(seeds[i]);
+}
+
+#endif // POLYCUBES_SEEDORDER_H_
@@ -0,0 +1,90 @@
+#ifndef POLYCUBES_SHAPESTATS_H_
+#define POLYCUBES_SHAPESTATS_H_
+
+#include "dynpolycube.h"
+#include "symmetry.h"
+
+#include <algorithm>
+#include <array>
+#include <map>
+#include <span>
+#include <vector>
+
+// Aggregate statistics over a set of polycubes. Every thread collects its
+// own ShapeStats, which are merged at the end.
+struct ShapeStats
+{
+    long shapes{};
+    // sorted extents (a <= b <= c) -> number of shapes
+    std::map<std::array<int, 3>, long> bounding_boxes;
+    // number of exposed faces -> number of shapes
+    std::map<int, long> surface_areas;
+    // number of cubes with 0..6 face neighbours
+    std::array<long, 7> neighbour_counts{};
+
+    bool with_symmetry = true;
+    SymmetryStats symmetry;
+
+    void add(std::span<const Coord> shape)
+    {
+        add_geometry(shape);
+        if (with_symmetry) symmetry.add(shape);
+    }
+
+    // Add normalized shapes of SIZE cubes, stored one after the other. The
+    // symmetries are classified with the batched kernel, which is several
+    // times faster than classifying the shapes one by one.
+    template <size_t SIZE>
+    void add_batch(std::span<const Coord> shapes)
+    {
+        auto const count = shapes.size() / SIZE;
+        for (size_t i{}; i < count; ++i) add_geometry(shapes.subspan(i * SIZE, SIZE));
+
+        if (with_symmetry) {
+            m_infos.resize(count);
+            classify_symmetry_batch<SIZE>(shapes, m_infos);
+            for (auto const& info : m_infos) symmetry.add(info);
+        }
+    }
+
+    void merge(ShapeStats const& other)
+    {
+        shapes += other.shapes;
+        for (auto const& [k, v] : other.bounding_boxes) bounding_boxes[k] += v;
+        for (auto const& [k, v] : other.surface_areas) surface_areas[k] += v;
+        for (size_t i{}; i < neighbour_counts.size(); ++i) neighbour_counts[i] += other.neighbour_counts[i];
+        symmetry.merge(other.symmetry);
+    }
+
+private:
+    void add_geometry(std::span<const Coord> shape)
+    {
+        ++shapes;
+
+        auto lo = min_coords(shape);
+        auto hi = max_coords(shape);
+        std::array<int, 3> extents{hi.x() - lo.x() + 1, hi.y() - lo.y() + 1, hi.z() - lo.z() + 1};
+        std::sort(extents.begin(), extents.end());
+        ++bounding_boxes[extents];
+
+        // the cubes of a normalized shape are sorted
+        static std::array<Coord, 6> const directions{
+            Coord{1, 0, 0}, Coord{-1, 0, 0}, Coord{0, 1, 0},
+            Coord{0, -1, 0}, Coord{0, 0, 1}, Coord{0, 0, -1}};
+        int surface{};
+        for (auto const& cube : shape) {
+            int neighbours{};
+            for (auto const& d : directions) {
+                neighbours += std::binary_search(shape.begin(), shape.end(), cube + d);
+            }
+            ++neighbour_counts[neighbours];
+            surface += 6 - neighbours;
+        }
+        ++surface_areas[surface];
+    }
+
+    // scratch space for add_batch
+    std::vector<SymmetryInfo> m_infos;
+};
+
+#endif // POLYCUBES_SHAPESTATS_H_
@@ -0,0 +1,271 @@
+#ifndef POLYCUBES_SYMMETRY_H_
+#define POLYCUBES_SYMMETRY_H_
+
+#include "dynpolycube.h"
+#include "polycube.h"
+#include "polycubeio.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <execution>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <span>
+#include <vector>
+
+// The polycubes are normalized under the 24 proper rotations only, i.e. a
+// shape and its mirror image are counted separately ("one-sided" polycubes).
+// Identifying mirror images as well (all 48 symmetries of the cube) gives the
+// "free" polycubes.
+
+struct SymmetryInfo
+{
+    // number of rotations that map the shape onto itself
+    int rotations;
+    // whether the shape is its own mirror image (up to rotation)
+    bool achiral;
+    // whether the shape is the normal form under rotation *and* reflection,
+    // i.e. not larger than the normal form of its mirror image
+    bool free_normal;
+
+    // size of the symmetry group of the shape (out of the 48 symmetries of the cube)
+    int order() const { return achiral ? 2 * rotations : rotations; }
+};
+
+// Classify a normalized shape
+inline SymmetryInfo classify_symmetry(std::span<const Coord> shape)
+{
+    auto const n = shape.size();
+    std::array<Coord, MAX_CUBE_COUNT> buf;
+    auto rotated = std::span{buf}.first(n);
+
+    SymmetryInfo result{};
+
+    // rotation stabilizer
+    for (int r = 0; r < N_ROTATIONS; ++r) {
+        std::transform(shape.begin(), shape.end(), rotated.begin(),
+            [r](Coord const& p) { return p.rot(r); });
+        auto origin = min_coords(rotated);
+        for (auto& block : rotated) {
+            block -= origin;
+        }
+        std::sort(rotated.begin(), rotated.end());
+        if (std::equal(rotated.begin(), rotated.end(), shape.begin())) ++result.rotations;
+    }
+
+    // mirror image
+    std::array<Coord, MAX_CUBE_COUNT> mirror_buf;
+    auto mirrored = std::span{mirror_buf}.first(n);
+    std::transform(shape.begin(), shape.end(), rotated.begin(),
+        [](Coord const& p) { return Coord{Coord::Scalar(-p.x()), p.y(), p.z()}; });
+    normalize(rotated, mirrored);
+
+    result.achiral = std::equal(mirrored.begin(), mirrored.end(), shape.begin());
+    result.free_normal = !std::lexicographical_compare(mirrored.begin(), mirrored.end(), shape.begin(), shape.end());
+    return result;
+}
+
+template <size_t SIZE>
+SymmetryInfo classify_symmetry(PolyCube<SIZE> const& s) { return classify_symmetry(std::span{s.cubes}); }
+
+inline SymmetryInfo classify_symmetry(DynPolyCube const& s) { return classify_symmetry(s.cubes); }
+
+// Classify many normalized shapes of SIZE cubes at once, stored one after the
+// other in shapes: out[i] = classify_symmetry(shape i). Like normalize_batch,
+// the 24 rotations and 24 mirrored rotations are computed for
+// NORMALIZE_BATCH_LANES shapes side by side.
+template <size_t SIZE>
+POLYCUBES_ALWAYS_INLINE void classify_symmetry_batch_impl(std::span<const Coord> shapes, std::span<SymmetryInfo> out)
+{
+    size_t constexpr L = NORMALIZE_BATCH_LANES;
+    auto const& perms = axis_permutations();
+    auto const count = shapes.size() / SIZE;
+
+    for (size_t first{}; first < count; first += L) {
+        size_t const n = std::min(L, count - first);
+
+        BatchCoords<SIZE> coords;
+        batch_load<SIZE>(n, [&](size_t l) { return shapes.data() + (first + l) * SIZE; }, coords);
+
+        // the shapes are normalized, so this is their own (smallest) form
+        BatchKeys<SIZE> own;
+        for (size_t i{}; i < SIZE; ++i) {
+            for (size_t l{}; l < L; ++l) {
+                own[i][l] = BatchKey(coords[0][i][l]) << 16 | BatchKey(coords[1][i][l]) << 8 | BatchKey(coords[2][i][l]);
+            }
+        }
+
+        BatchKeys<SIZE> keys;
+        std::array<int, L> rotations{};
+        for (auto const& perm : perms) {
+            batch_rotated_keys<SIZE>(coords, perm, keys);
+            std::array<BatchKey, L> same;
+            same.fill(1);
+            for (size_t i{}; i < SIZE; ++i) {
+                for (size_t l{}; l < L; ++l) same[l] &= keys[i][l] == own[i][l];
+            }
+            for (size_t l{}; l < L; ++l) rotations[l] += (int)same[l];
+        }
+
+        BatchKeys<SIZE> mirror;
+        for (auto& m : mirror) m.fill(std::numeric_limits<BatchKey>::max());
+        for (auto const& perm : perms) {
+            batch_rotated_keys<SIZE, true>(coords, perm, keys);
+            batch_keep_smaller<SIZE>(mirror, keys);
+        }
+        auto const mirror_less = batch_less<SIZE>(mirror, own);
+
+        for (size_t l{}; l < n; ++l) {
+            bool achiral = true;
+            for (size_t i{}; i < SIZE; ++i) achiral &= mirror[i][l] == own[i][l];
+            out[first + l] = SymmetryInfo{rotations[l], achiral, !mirror_less[l]};
+        }
+    }
+}
+
+template <size_t SIZE>
+void classify_symmetry_batch_generic(std::span<const Coord> shapes, std::span<SymmetryInfo> out)
+{
+    classify_symmetry_batch_impl<SIZE>(shapes, out);
+}
+
+#if POLYCUBES_X86_DISPATCH
+template <size_t SIZE>
+POLYCUBES_TARGET_AVX2 void classify_symmetry_batch_avx2(std::span<const Coord> shapes, std::span<SymmetryInfo> out)
+{
+    classify_symmetry_batch_impl<SIZE>(shapes, out);
+}
+
+template <size_t SIZE>
+POLYCUBES_TARGET_AVX512 void classify_symmetry_batch_avx512(std::span<const Coord> shapes, std::span<SymmetryInfo> out)
+{
+    classify_symmetry_batch_impl<SIZE>(shapes, out);
+}
+#endif
+
+// classify_symmetry_batch_impl compiled for the best instruction set this CPU
+// supports
+template <size_t SIZE>
+void classify_symmetry_batch(std::span<const Coord> shapes, std::span<SymmetryInfo> out)
+{
+    if (shapes.size() % SIZE != 0 || out.size() < shapes.size() / SIZE)
+        throw std::invalid_argument("classify_symmetry_batch: sizes don't match");
+
+    switch (cpu_isa())
+    {
+#if POLYCUBES_X86_DISPATCH
+        case IsaLevel::avx512: return classify_symmetry_batch_avx512<SIZE>(shapes, out);
+        case IsaLevel::avx2: return classify_symmetry_batch_avx2<SIZE>(shapes, out);
+#endif
+        default: return classify_symmetry_batch_generic<SIZE>(shapes, out);
+    }
+}
+
+// Counts of one-sided and free polycubes, and the distribution of symmetry
+// group orders
+struct SymmetryStats
+{
+    long one_sided{};
+    long free{};
+    long achiral{};
+    // symmetry group order -> number of one-sided polycubes
+    std::map<int, long> orders;
+
+    template <typename Shape>
+    SymmetryInfo add(Shape const& s)
+    {
+        auto info = classify_symmetry(s);
+        add(info);
+        return info;
+    }
+
+    // a shape that is classified already
+    void add(SymmetryInfo const& info)
+    {
+        ++one_sided;
+        if (info.free_normal) ++free;
+        if (info.achiral) ++achiral;
+        ++orders[info.order()];
+    }
+
+    void merge(SymmetryStats const& other)
+    {
+        one_sided += other.one_sided;
+        free += other.free;
+        achiral += other.achiral;
+        for (auto const& [order, count] : other.orders) orders[order] += count;
+    }
+};
+
+// Classifies shapes while they are written, so that no extra pass over the
+// list is needed: add() collects them in order, and every full batch is
+// classified in parallel ranges. If free_outfile is not empty, the free
+// polycubes (the shapes that are their free normal form) are written there,
+// in the order they were added.
+class SymmetryClassifier
+{
+    static size_t constexpr BATCH_SIZE = 1 << 20;
+    static size_t constexpr RANGE_SIZE = 1 << 14;
+
+public:
+    SymmetryClassifier(size_t cube_count, std::filesystem::path const& free_outfile = {})
+        : m_batch{cube_count}
+    {
+        if (!free_outfile.empty()) m_free_out = std::make_unique<DynPolyCubeListFileWriter>(free_outfile, cube_count);
+    }
+
+    template <typename Shape>
+    void add(Shape const& s)
+    {
+        m_batch.push_back(std::span<const Coord>{s.cubes});
+        if (m_batch.size() >= BATCH_SIZE) classify_batch();
+    }
+
+    // classifies the rest, and returns the counts of all shapes added
+    SymmetryStats const& finish()
+    {
+        classify_batch();
+        return m_stats;
+    }
+
+    // time spent classifying
+    double seconds() const { return m_seconds; }
+
+private:
+    void classify_batch()
+    {
+        auto const t0 = std::chrono::steady_clock::now();
+        auto const range_count = (m_batch.size() + RANGE_SIZE - 1) / RANGE_SIZE;
+        std::vector<SymmetryStats> range_stats(range_count);
+        m_free_normal.resize(m_batch.size());
+        std::vector<size_t> ranges(range_count);
+        std::iota(ranges.begin(), ranges.end(), 0);
+        std::for_each(std::execution::par, ranges.begin(), ranges.end(), [&](size_t r) {
+            auto const end = std::min(m_batch.size(), (r + 1) * RANGE_SIZE);
+            for (size_t i = r * RANGE_SIZE; i < end; ++i) {
+                m_free_normal[i] = range_stats[r].add(m_batch[i]).free_normal;
+            }
+        });
+
+        for (auto const& stats : range_stats) m_stats.merge(stats);
+        if (m_free_out) {
+            for (size_t i{}; i < m_batch.size(); ++i) {
+                if (m_free_normal[i]) m_free_out->write(m_batch[i]);
+            }
+        }
+        m_batch.clear();
+        m_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+    PolyCubeArena m_batch;
+    std::vector<uint8_t> m_free_normal;
+    std::unique_ptr<DynPolyCubeListFileWriter> m_free_out;
+    SymmetryStats m_stats;
+    double m_seconds{};
+};
+
+#endif // POLYCUBES_SYMMETRY_H_
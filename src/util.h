@@ -70,6 +70,12 @@ void merge_uniq(R1 old_range, std::span<R2> new_ranges, OutFunc f)
 }
 
 
+template <typename TimePoint>
+double seconds_between(TimePoint t0, TimePoint t1)
+{
+    return std::chrono::duration<double>(t1 - t0).count();
+}
+
 inline std::string strftime_local(char const* fmt, std::chrono::time_point<std::chrono::system_clock> t)
 {
     size_t constexpr buf_len = 1024;